@@ -0,0 +1,472 @@
+// Times each phase of a conversion separately: loading the file, parsing the
+// elements, collecting the SmartType lists, generating the fdx and writing
+// it out. Linux only, every input runs in its own child process so the peak
+// RSS is that input's alone. malloc and friends are wrapped at link time to
+// count allocations, see build.sh.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "converter/filestuff.h"
+#include "converter/fountain.h"
+#include "converter/fdx.h"
+#include "converter/sink.h"
+#include "bench/generate.h"
+
+const char bench_help_string[] =
+"Benchmark the .fountain to .fdx conversion phase by phase.\n"
+"   usage: %s [options] [files...]\n"
+"\n"
+"   --runs N       Best of N runs per input (default 3)\n"
+"   --seed N       Seed for the generated screenplays (default 1)\n"
+"   --sizes LIST   Generated screenplay sizes, like 100K,1M,10M,1G (default 100K,1M,10M,100M)\n"
+"   --no-generate  Only run the given files and the ones in tests/\n"
+"   --dir PATH     Where generated input and the output go (default $TMPDIR or /tmp)\n"
+"   --keep         Don't delete the generated screenplays\n"
+"   --threads N    Parse and generate on N threads (default 1). SmartType collection is\n"
+"                  counted as parsing and writing as generating then\n"
+"   --output KIND  How the fdx is written: sink (default), mmap or writev. Writing is\n"
+"                  counted as generating for mmap and writev\n"
+;
+
+// Allocation counting
+
+typedef struct _Alloc_Stats
+{
+    size_t allocs;      // malloc, calloc and realloc calls
+    size_t frees;
+    size_t bytes;       // Requested, not what the allocator handed out
+} Alloc_Stats;
+
+static Alloc_Stats alloc_stats;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void  __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+    alloc_stats.allocs++;
+    alloc_stats.bytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    alloc_stats.allocs++;
+    alloc_stats.bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    alloc_stats.allocs++;
+    alloc_stats.bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr)
+        alloc_stats.frees++;
+
+    __real_free(ptr);
+}
+
+// Phases
+
+typedef enum _Phase
+{
+    PHASE_LOAD,
+    PHASE_PARSE,
+    PHASE_SMARTTYPE,
+    PHASE_GENERATE,
+    PHASE_WRITE,
+    PHASE_COUNT,
+} Phase;
+
+static const char* phase_names[PHASE_COUNT] = { "load", "parse", "smarttype", "generate", "write" };
+
+typedef struct _Result
+{
+    int ok;
+    double seconds[PHASE_COUNT];    // Best of all the runs, each phase on its own
+    size_t input_size;
+    size_t output_size;
+    int elements;
+    long peak_rss_kb;
+    Alloc_Stats allocs;             // Of one run, they're all the same
+} Result;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The fdx is generated into a sink that writes to the output file, the time
+// spent in write() is taken out of generation and counted as writing
+typedef struct _Output
+{
+    int fd;
+    size_t size;
+    double write_seconds;
+} Output;
+
+static int output_write(void* user, const char* data, size_t size)
+{
+    Output* out = (Output*) user;
+    double start = now();
+
+    out->size += size;
+    while (size > 0)
+    {
+        ssize_t written = write(out->fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return 0;
+        }
+
+        data += written;
+        size -= (size_t) written;
+    }
+
+    out->write_seconds += now() - start;
+    return 1;
+}
+
+static int threads = 1;
+static const char* output_kind = "sink";
+
+static int run_once(const char* input_path, const char* output_path, double seconds[PHASE_COUNT], Result* result)
+{
+    double start = now();
+
+    File_View input;
+    if (!load_file(input_path, &input))
+    {
+        fprintf(stderr, "Couldn't read file \"%s\"\n", input_path);
+        return 0;
+    }
+
+    double loaded = now();
+
+    Parser parser = parser_make(input.data, input.size, NULL);
+    if (threads > 1)
+        parser_parse_parallel(&parser, threads);
+    else
+        parser_parse_elements(&parser);
+
+    double parsed = now();
+
+    if (threads <= 1)
+        parser_collect_smarttype(&parser);
+
+    double collected = now();
+
+    Output out = { 0 };
+    int ok;
+
+    int mapped   = strcmp(output_kind, "mmap") == 0;
+    int gathered = strcmp(output_kind, "writev") == 0;
+
+    if (threads > 1 || mapped || gathered)
+    {
+        // Everything is written as it's rendered, writing can't be told apart
+        if (mapped)
+            ok = generate_fdx_mapped(&parser, (char*) output_path, OUTPUT_SYNC_NONE);
+        else if (gathered)
+            ok = generate_fdx_gathered(&parser, (char*) output_path);
+        else
+            ok = generate_fdx_parallel(&parser, (char*) output_path, threads);
+
+        struct stat st;
+        if (ok && stat(output_path, &st) == 0)
+            out.size = (size_t) st.st_size;
+    }
+    else
+    {
+        out.fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out.fd < 0)
+        {
+            fprintf(stderr, "Couldn't write file \"%s\"\n", output_path);
+            parser_free(&parser);
+            unload_file(&input);
+            return 0;
+        }
+
+        Sink sink = sink_make_callback(output_write, &out);
+        write_fdx(&parser, &sink);
+        ok = sink_close(&sink);
+
+        double close_start = now();
+        ok = (close(out.fd) == 0) && ok;
+        out.write_seconds += now() - close_start;
+    }
+
+    double generated = now();
+
+    result->input_size  = input.size;
+    result->output_size = out.size;
+    result->elements    = da_size(parser.elements) + (int) map_count(parser.title_page_details);
+
+    parser_free(&parser);
+    unload_file(&input);
+
+    seconds[PHASE_LOAD]      = loaded - start;
+    seconds[PHASE_PARSE]     = parsed - loaded;
+    seconds[PHASE_SMARTTYPE] = (threads > 1) ? 0 : collected - parsed;
+    seconds[PHASE_GENERATE]  = generated - collected - out.write_seconds;
+    seconds[PHASE_WRITE]     = out.write_seconds;
+
+    if (!ok)
+        fprintf(stderr, "Couldn't write file \"%s\"\n", output_path);
+
+    return ok;
+}
+
+static void run_child(const char* input_path, const char* output_path, int runs, int fd)
+{
+    Result result = { 0 };
+    result.ok = 1;
+
+    for (int run = 0; run < runs && result.ok; run++)
+    {
+        double seconds[PHASE_COUNT];
+
+        alloc_stats = (Alloc_Stats) { 0 };
+        result.ok = run_once(input_path, output_path, seconds, &result);
+        result.allocs = alloc_stats;
+
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            if (run == 0 || seconds[p] < result.seconds[p])
+                result.seconds[p] = seconds[p];
+        }
+    }
+
+    unlink(output_path);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+        _exit(1);
+
+    _exit(0);
+}
+
+static int run_input(const char* input_path, const char* output_path, int runs, Result* result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 0;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        run_child(input_path, output_path, runs, fds[1]);
+    }
+
+    close(fds[1]);
+
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    return got == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && result->ok;
+}
+
+// Reporting
+
+static const char* format_size(double bytes, char* buffer, size_t buffer_size)
+{
+    const char* units[] = { "B", "KB", "MB", "GB" };
+    int unit = 0;
+    while (bytes >= 1024 && unit < 3)
+    {
+        bytes /= 1024;
+        unit++;
+    }
+
+    snprintf(buffer, buffer_size, unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+    return buffer;
+}
+
+static void report(const char* name, Result* result)
+{
+    char input[32], output[32], rss[32], requested[32];
+    double mb = result->input_size / (1024.0 * 1024.0);
+
+    printf("%s\n", name);
+    printf("  input %s, %d elements, output %s\n",
+           format_size(result->input_size, input, sizeof(input)), result->elements,
+           format_size(result->output_size, output, sizeof(output)));
+
+    printf("  %-10s %10s %12s %14s\n", "phase", "ms", "MB/s", "elements/s");
+
+    double total = 0;
+    for (int p = 0; p <= PHASE_COUNT; p++)
+    {
+        const char* name = (p < PHASE_COUNT) ? phase_names[p] : "total";
+        double seconds = (p < PHASE_COUNT) ? result->seconds[p] : total;
+        total += seconds;
+
+        // Folded into another phase
+        if (seconds <= 0)
+        {
+            printf("  %-10s %10s %12s %14s\n", name, "-", "-", "-");
+            continue;
+        }
+
+        printf("  %-10s %10.3f %12.1f %14.0f\n", name, seconds * 1000, mb / seconds, result->elements / seconds);
+    }
+
+    printf("  peak rss %s, %zu allocations, %zu frees, %s requested\n\n",
+           format_size(result->peak_rss_kb * 1024.0, rss, sizeof(rss)),
+           result->allocs.allocs, result->allocs.frees,
+           format_size((double) result->allocs.bytes, requested, sizeof(requested)));
+}
+
+// Like 100K, 1M or 1G
+static size_t parse_size(const char* str)
+{
+    char* end;
+    double value = strtod(str, &end);
+
+    switch (*end)
+    {
+        case 'k': case 'K': value *= 1024; break;
+        case 'm': case 'M': value *= 1024 * 1024; break;
+        case 'g': case 'G': value *= 1024 * 1024 * 1024; break;
+    }
+
+    return value > 0 ? (size_t) value : 0;
+}
+
+static int file_exists(const char* filepath)
+{
+    return access(filepath, R_OK) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int runs = 3;
+    uint64_t seed = 1;
+    const char* sizes = "100K,1M,10M,100M";
+    int keep = 0;
+    const char* dir = getenv("TMPDIR");
+    if (!dir || !*dir)
+        dir = "/tmp";
+
+    const char** files = (const char**) malloc(sizeof(char*) * (argc + 2));
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        int has_value = i + 1 < argc;
+
+        if      (strcmp(arg, "--runs") == 0 && has_value)    runs    = atoi(argv[++i]);
+        else if (strcmp(arg, "--seed") == 0 && has_value)    seed    = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(arg, "--sizes") == 0 && has_value)   sizes   = argv[++i];
+        else if (strcmp(arg, "--dir") == 0 && has_value)     dir     = argv[++i];
+        else if (strcmp(arg, "--threads") == 0 && has_value) threads = atoi(argv[++i]);
+        else if (strcmp(arg, "--output") == 0 && has_value)  output_kind = argv[++i];
+        else if (strcmp(arg, "--no-generate") == 0)          sizes   = "";
+        else if (strcmp(arg, "--keep") == 0)                 keep    = 1;
+        else if (arg[0] == '-')
+        {
+            printf(bench_help_string, argv[0]);
+            free(files);
+            return strcmp(arg, "--help") != 0;
+        }
+        else
+            files[file_count++] = arg;
+    }
+
+    if (runs < 1)
+        runs = 1;
+
+    if (file_exists("tests/Big Fish.fountain"))
+        files[file_count++] = "tests/Big Fish.fountain";
+    if (file_exists("tests/Brick & Steel.fountain"))
+        files[file_count++] = "tests/Brick & Steel.fountain";
+
+    char output_path[4096];
+    snprintf(output_path, sizeof(output_path), "%s/ffbench_%d.fdx", dir, (int) getpid());
+
+    int failed = 0;
+    Result result;
+
+    for (int i = 0; i < file_count; i++)
+    {
+        if (run_input(files[i], output_path, runs, &result))
+            report(files[i], &result);
+        else
+            failed = 1;
+    }
+
+    // Generated screenplays, made one at a time so only one is on disk
+    for (const char* s = sizes; *s; )
+    {
+        size_t size = parse_size(s);
+        const char* comma = strchr(s, ',');
+        int length = comma ? (int) (comma - s) : (int) strlen(s);
+
+        if (size > 0)
+        {
+            char input_path[4096], name[64];
+            snprintf(input_path, sizeof(input_path), "%s/ffbench_%.*s_%llu.fountain", dir, length, s, (unsigned long long) seed);
+            snprintf(name, sizeof(name), "generated %.*s (seed %llu)", length, s, (unsigned long long) seed);
+
+            if (!file_exists(input_path) && !generate_screenplay_file(input_path, size, seed))
+            {
+                fprintf(stderr, "Couldn't write file \"%s\"\n", input_path);
+                failed = 1;
+                break;
+            }
+
+            if (run_input(input_path, output_path, runs, &result))
+                report(name, &result);
+            else
+                failed = 1;
+
+            if (!keep)
+                unlink(input_path);
+        }
+
+        s += length;
+        if (*s == ',')
+            s++;
+    }
+
+    free(files);
+    return failed;
+}
\ No newline at end of file
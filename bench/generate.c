@@ -0,0 +1,283 @@
+#include "generate.h"
+
+#include <string.h>
+
+typedef struct _Generator
+{
+    Sink* sink;
+    size_t written;
+    uint64_t state;
+
+    int location_count;     // Scenes mostly go back to places seen before
+    int cast_count;
+} Generator;
+
+static const char* intros[] = { "INT.", "INT.", "INT.", "EXT.", "EXT.", "INT./EXT.", "I/E." };
+static const char* times[]  = { "DAY", "DAY", "NIGHT", "NIGHT", "CONTINUOUS", "LATER", "MORNING", "EVENING", "MOMENTS LATER", "DUSK" };
+
+static const char* places[] = {
+    "KITCHEN", "LIVING ROOM", "POLICE STATION", "DINER", "PARKING LOT", "WAREHOUSE", "HOSPITAL CORRIDOR",
+    "HIGH SCHOOL GYM", "MOTEL ROOM", "CAR", "ROOFTOP", "CHURCH", "BACKYARD", "OFFICE", "BAR", "RIVERBANK",
+    "TRAIN STATION", "BASEMENT", "LIBRARY", "FARMHOUSE", "GAS STATION", "BEDROOM", "HALLWAY", "FOREST",
+};
+static const char* owners[] = {
+    "BRICK'S", "STEEL'S", "THE BLOOMS'", "MAYOR'S", "OLD", "ABANDONED", "DOWNTOWN", "JENNY'S", "EDWARD'S", "SANDRA'S",
+};
+
+static const char* names[] = {
+    "BRICK", "STEEL", "EDWARD", "SANDRA", "WILL", "JOSEPHINE", "KARL", "NORTHER WINSLOW", "JENNY", "DR. BENNETT",
+    "AMOS CALLOWAY", "MILDRED", "DON PRICE", "THE WITCH", "BEAMEN", "YOUNG EDWARD", "SENIOR EDWARD", "NURSE",
+    "OFFICER", "WAITRESS", "MAN #1", "MAN #2", "DETECTIVE LANE", "GRANDMA", "ROSIE", "MCCOY",
+};
+static const char* extensions[] = { " (V.O.)", " (O.S.)", " (CONT'D)", " (O.C.)" };
+
+static const char* parentheticals[] = {
+    "(beat)", "(quietly)", "(laughing)", "(to Edward)", "(re: the letter)", "(under her breath)",
+    "(beat; then)", "(into phone)", "(sotto)", "(continuing)",
+};
+
+static const char* transitions[] = { "CUT TO:", "CUT TO:", "DISSOLVE TO:", "SMASH CUT TO:", "MATCH CUT TO:", "FADE TO:" };
+
+static const char* words[] = {
+    "the", "the", "the", "a", "a", "and", "and", "of", "to", "in", "his", "her", "it", "with", "on", "at", "back",
+    "door", "window", "light", "water", "car", "hand", "face", "table", "letter", "phone", "gun", "glass", "river",
+    "looks", "turns", "walks", "stops", "opens", "grabs", "watches", "smiles", "waits", "runs", "sits", "listens",
+    "slowly", "quickly", "finally", "again", "still", "just", "never", "always", "almost", "suddenly",
+    "old", "small", "dark", "empty", "quiet", "broken", "cold", "bright", "long", "strange", "beautiful",
+    "know", "think", "want", "remember", "said", "told", "going", "gonna", "really", "maybe", "nothing", "everything",
+    "you", "you", "I", "I", "we", "they", "me", "what", "that", "this", "there", "here", "now", "then", "why",
+    "fish", "town", "story", "witch", "eye", "circus", "giant", "war", "night", "morning", "rain", "storm",
+    "can't", "don't", "it's", "that's", "ain't", "I'm", "you're", "he's", "she's",
+};
+
+#define count_of(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+// xorshift64*, plenty for picking words
+static uint64_t next_random(Generator* gen)
+{
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return gen->state * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_int(Generator* gen, int n)
+{
+    return (int) ((next_random(gen) >> 33) % (uint64_t) n);
+}
+
+// Percent chance
+static int chance(Generator* gen, int percent)
+{
+    return random_int(gen, 100) < percent;
+}
+
+#define pick(gen, a) ((a)[random_int(gen, count_of(a))])
+
+static void put(Generator* gen, const char* str)
+{
+    size_t length = strlen(str);
+    sink_write(gen->sink, str, length);
+    gen->written += length;
+}
+
+static void put_char(Generator* gen, char ch)
+{
+    sink_write(gen->sink, &ch, 1);
+    gen->written++;
+}
+
+static void put_sentence(Generator* gen, int dialogue)
+{
+    int count = 3 + random_int(gen, dialogue ? 9 : 14);
+    for (int i = 0; i < count; i++)
+    {
+        const char* word = pick(gen, words);
+
+        if (i == 0)
+        {
+            put_char(gen, (word[0] >= 'a' && word[0] <= 'z') ? word[0] - 'a' + 'A' : word[0]);
+            put(gen, word + 1);
+            continue;
+        }
+
+        put_char(gen, ' ');
+
+        // Emphasis is rare but should be there
+        int emphasis = random_int(gen, 200);
+        if (emphasis == 0)
+        {
+            put(gen, "*"); put(gen, word); put(gen, "*");
+        }
+        else if (emphasis == 1)
+        {
+            put(gen, "**"); put(gen, word); put(gen, "**");
+        }
+        else if (emphasis == 2)
+        {
+            put(gen, "_"); put(gen, word); put(gen, "_");
+        }
+        else if (emphasis == 3 && !dialogue)
+        {
+            // Sound effects and props in caps
+            for (const char* c = word; *c; c++)
+                put_char(gen, (*c >= 'a' && *c <= 'z') ? *c - 'a' + 'A' : *c);
+        }
+        else
+            put(gen, word);
+
+        if (i + 1 < count && chance(gen, 6))
+            put_char(gen, ',');
+    }
+
+    put(gen, chance(gen, 80) ? "." : (chance(gen, 50) ? "?" : "!"));
+}
+
+static void put_paragraph(Generator* gen, int dialogue, int max_sentences)
+{
+    int count = 1 + random_int(gen, max_sentences);
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            put(gen, chance(gen, 70) ? " " : "  ");
+
+        put_sentence(gen, dialogue);
+
+        // Some writers wrap long paragraphs by hand
+        if (!dialogue && i + 1 < count && chance(gen, 10))
+            put_char(gen, '\n');
+    }
+
+    put_char(gen, '\n');
+}
+
+static void put_title_page(Generator* gen)
+{
+    put(gen, "Title:\n    _**THE LONG ");
+    put(gen, pick(gen, places));
+    put(gen, "**_\n    A Made Up Story\n");
+    put(gen, "Credit: Written by\n");
+    put(gen, "Author: ");
+    put(gen, pick(gen, names));
+    put(gen, " & ");
+    put(gen, pick(gen, names));
+    put(gen, "\nSource: Based on the stories of ");
+    put(gen, pick(gen, names));
+    put(gen, "\nDraft date: 10/16/2026\n");
+    put(gen, "Contact:\n    Generated Pictures\n    1588 Mission Dr.\n    Solvang, CA 93463\n\n");
+}
+
+static void put_scene_heading(Generator* gen)
+{
+    // Forced scene headings start with a '.'
+    if (chance(gen, 3))
+    {
+        put(gen, ".");
+        put(gen, pick(gen, places));
+        put(gen, "\n\n");
+        return;
+    }
+
+    // New locations keep showing up but most scenes reuse old ones, so the
+    // SmartType lists grow like they do in a real script
+    if (gen->location_count < count_of(places) * count_of(owners) && chance(gen, 30))
+        gen->location_count++;
+
+    int location = gen->location_count ? random_int(gen, gen->location_count) : 0;
+
+    put(gen, pick(gen, intros));
+    put_char(gen, ' ');
+    put(gen, owners[location / count_of(places)]);
+    put_char(gen, ' ');
+    put(gen, places[location % count_of(places)]);
+
+    if (chance(gen, 90))
+    {
+        put(gen, " - ");
+        put(gen, pick(gen, times));
+    }
+
+    put(gen, "\n\n");
+}
+
+static void put_dialogue_block(Generator* gen)
+{
+    int name = random_int(gen, gen->cast_count);
+    put(gen, names[name]);
+    if (chance(gen, 12))
+        put(gen, pick(gen, extensions));
+    put_char(gen, '\n');
+
+    int count = 1 + random_int(gen, 3);
+    for (int i = 0; i < count; i++)
+    {
+        if (chance(gen, 25))
+        {
+            put(gen, pick(gen, parentheticals));
+            put_char(gen, '\n');
+        }
+
+        put_paragraph(gen, 1, 3);
+    }
+
+    put_char(gen, '\n');
+}
+
+static void put_scene(Generator* gen)
+{
+    put_scene_heading(gen);
+
+    // Supporting characters show up as the story goes
+    if (gen->cast_count < count_of(names) && chance(gen, 20))
+        gen->cast_count++;
+
+    int beats = 2 + random_int(gen, 10);
+    for (int i = 0; i < beats; i++)
+    {
+        if (chance(gen, 45))
+        {
+            put_paragraph(gen, 0, 4);
+            put_char(gen, '\n');
+        }
+        else
+            put_dialogue_block(gen);
+    }
+
+    int extra = random_int(gen, 100);
+    if (extra < 2)
+        put(gen, "> THE END? <\n\n");
+    else if (extra < 4)
+        put(gen, "===\n\n");
+    else if (extra < 5)
+        put(gen, "/* Cut for time\nNOT SURE ABOUT THIS\n*/\n\n");
+    else if (extra < 30)
+    {
+        put(gen, pick(gen, transitions));
+        put(gen, "\n\n");
+    }
+}
+
+size_t generate_screenplay(Sink* sink, size_t size, uint64_t seed)
+{
+    Generator gen = { 0 };
+    gen.sink  = sink;
+    gen.state = seed * 0x9E3779B97F4A7C15ULL + 1;   // Never 0
+    gen.location_count = 4;
+    gen.cast_count = 4;
+
+    put_title_page(&gen);
+    while (gen.written < size)
+        put_scene(&gen);
+
+    return gen.written;
+}
+
+int generate_screenplay_file(const char* filepath, size_t size, uint64_t seed)
+{
+    Sink sink;
+    if (!sink_open_file(&sink, filepath))
+        return 0;
+
+    generate_screenplay(&sink, size, seed);
+    return sink_close(&sink);
+}
\ No newline at end of file
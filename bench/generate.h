@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "converter/sink.h"
+
+// Writes a made up but realistic screenplay of at least size bytes to sink:
+// a title page, then scenes with headings, action, dialogue blocks with
+// parentheticals and extensions, transitions, emphasis, the odd centered
+// text, page break and boneyard. The same seed always gives the same text.
+// Returns the number of bytes written.
+size_t generate_screenplay(Sink* sink, size_t size, uint64_t seed);
+
+// Same thing into a file, returns 0 if it couldn't be written
+int generate_screenplay_file(const char* filepath, size_t size, uint64_t seed);
\ No newline at end of file
@@ -0,0 +1,16 @@
+#!/bin/sh
+# build.bat for gcc/clang, without the DEBUG main. ./build.sh bench builds the benchmark,
+# ./build.sh verify the parser_edit checker, run it from here so it finds tests/.
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--g -O2}
+
+if [ "$1" = "bench" ]; then
+    # Wrapping the allocator lets the benchmark count allocations
+    $CC $CFLAGS -I ./ converter/*.c bench/*.c -o ffbench -lpthread \
+        -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+elif [ "$1" = "verify" ]; then
+    $CC $CFLAGS -DPARSER_VERIFY_EDITS -I ./ converter/*.c verify/*.c -o ffverify -lpthread
+else
+    $CC $CFLAGS -I ./ converter/*.c main.c -o fftest -lpthread
+fi
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+    PURE C ALLOCATION COUNTING
+    The containers allocate through container_malloc and container_realloc,
+    which count the calls and the bytes asked for while counting is on.
+    Frees aren't counted. Turning it on and off is one int, the counters are
+    only touched while it's on and are safe to bump from any thread.
+
+    To create the implementaion use:
+        #define ALLOC_COUNT_IMPL
+    before you include this file in *one* C or C++ file.
+
+    Counting can be removed from the containers by using:
+        #define CONTAINER_NO_ALLOC_COUNT
+    before creating their implementations, the counters then stay at 0.
+
+    Example:
+        container_allocs.counting = 1;
+        ...
+        printf("%lld allocations\n", container_allocs.calls);
+*/
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef struct _Alloc_Count
+{
+    int counting;
+    long long calls;
+    long long bytes;
+} Alloc_Count;
+
+extern Alloc_Count container_allocs;
+
+void alloc_count_add(size_t size);
+
+#ifndef CONTAINER_NO_ALLOC_COUNT
+#define alloc_count(size)               (container_allocs.counting ? alloc_count_add(size) : (void) 0)
+#else
+#define alloc_count(size)               ((void) 0)
+#endif
+
+#define container_malloc(size)          (alloc_count(size), malloc(size))
+#define container_realloc(ptr, size)    (alloc_count(size), realloc(ptr, size))
+
+#endif // ALLOC_COUNT_H
+
+#ifdef ALLOC_COUNT_IMPL
+
+#ifndef ALLOC_COUNT_IMPLEMENTED
+#define ALLOC_COUNT_IMPLEMENTED
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+Alloc_Count container_allocs;
+
+void alloc_count_add(size_t size)
+{
+#ifdef _MSC_VER
+    _InterlockedExchangeAdd64(&container_allocs.calls, 1);
+    _InterlockedExchangeAdd64(&container_allocs.bytes, (long long) size);
+#else
+    __atomic_fetch_add(&container_allocs.calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&container_allocs.bytes, (long long) size, __ATOMIC_RELAXED);
+#endif
+}
+
+#endif // ALLOC_COUNT_IMPLEMENTED
+
+#endif // ALLOC_COUNT_IMPL
\ No newline at end of file
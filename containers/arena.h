@@ -0,0 +1,250 @@
+/*
+    PURE C ARENA ALLOCATOR
+    Memory is handed out from big chunks by bumping an offset, nothing is freed
+    on its own. arena_reset makes all of it available again in constant time and
+    keeps the chunks around so the next round of allocations doesn't hit malloc.
+
+    To create the implementaion use:
+        #define ARENA_IMPL
+    before you include this file in *one* C or C++ file.
+
+    Default chunk size is 64KB.
+    The chunk size can be changed for all arenas by using:
+        #define ARENA_CHUNK_SIZE <value>
+    before creating the implementation, or per arena with arena_make.
+    Allocations that are bigger than the chunk size get a chunk of their own.
+
+    Every allocation is aligned to ARENA_ALIGNMENT which is 16 by default.
+
+    Assertions in the implementation can be removed by using:
+        #define CONTAINER_NO_ASSERT
+    before creating the implemenation.
+
+    Allocations go through alloc_count.h, its implementation has to be
+    created somewhere too.
+
+    Example:
+        #define ARENA_IMPL
+        #include "containers/arena.h"
+
+        Arena arena = arena_make(0);
+        Foo* foo  = arena_push(&arena, Foo);
+        int* ints = arena_push_array(&arena, int, 10);
+        arena_reset(&arena);    // foo and ints are gone, the memory isn't
+        arena_free(&arena);
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifndef ARENA_CHUNK_SIZE
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#endif // ARENA_CHUNK_SIZE
+
+#ifndef ARENA_ALIGNMENT
+#define ARENA_ALIGNMENT 16
+#endif // ARENA_ALIGNMENT
+
+typedef struct _Arena_Chunk
+{
+    struct _Arena_Chunk* next;
+    size_t cap;
+    size_t used;
+    char   buffer[];
+} Arena_Chunk;
+
+typedef struct _Arena
+{
+    Arena_Chunk* first;
+    Arena_Chunk* current;
+    size_t chunk_size;
+} Arena;
+
+#define arena_push(arena, type)          (type*) arena_alloc(arena, sizeof(type))
+#define arena_push_array(arena, type, n) (type*) arena_alloc(arena, sizeof(type) * (n))
+
+Arena arena_make(size_t chunk_size);    // 0 for ARENA_CHUNK_SIZE
+void  arena_reset(Arena* arena);
+void  arena_free(Arena* arena);
+
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_copy_string(Arena* arena, const char* str, size_t n);
+
+// Moves other's chunks into arena, what was allocated from other stays valid
+// and is freed or reset with arena. other is left empty.
+void  arena_absorb(Arena* arena, Arena* other);
+
+// Where the arena is at. arena_rewind frees everything allocated after the
+// mark, the chunks stay around like they do for a reset.
+typedef struct _Arena_Mark
+{
+    Arena_Chunk* chunk;
+    size_t used;
+} Arena_Mark;
+
+Arena_Mark arena_mark(Arena* arena);
+void       arena_rewind(Arena* arena, Arena_Mark mark);
+
+#endif // ARENA_H
+
+#ifdef ARENA_IMPL
+
+#ifndef ARENA_IMPLEMENTED
+#define ARENA_IMPLEMENTED
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hd_assert.h"
+#include "alloc_count.h"
+
+/*
+    Arena memory layout:
+    first -> [next, cap, used, buffer...] -> [next, cap, used, buffer...] -> NULL
+                                              ^ current
+    Chunks after current are left over from before a reset, their used
+    is stale and gets cleared when current moves onto them.
+*/
+
+Arena arena_make(size_t chunk_size)
+{
+    Arena arena = { NULL, NULL, chunk_size ? chunk_size : ARENA_CHUNK_SIZE };
+    return arena;
+}
+
+void arena_reset(Arena* arena)
+{
+    arena->current = arena->first;
+
+    if (arena->first)
+        arena->first->used = 0;
+}
+
+void arena_free(Arena* arena)
+{
+    Arena_Chunk* chunk = arena->first;
+    while (chunk)
+    {
+        Arena_Chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->first = arena->current = NULL;
+}
+
+// Offset in chunk where an aligned allocation would start
+static size_t arena_aligned_offset(Arena_Chunk* chunk)
+{
+    uintptr_t at = (uintptr_t) (chunk->buffer + chunk->used);
+    uintptr_t aligned = (at + (ARENA_ALIGNMENT - 1)) & ~(uintptr_t) (ARENA_ALIGNMENT - 1);
+    return chunk->used + (aligned - at);
+}
+
+void* arena_alloc(Arena* arena, size_t size)
+{
+    Arena_Chunk* chunk = arena->current;
+
+    if (chunk)
+    {
+        size_t offset = arena_aligned_offset(chunk);
+        if (offset + size <= chunk->cap)
+        {
+            chunk->used = offset + size;
+            return chunk->buffer + offset;
+        }
+
+        // Move on to a chunk from before a reset if it's big enough
+        Arena_Chunk* next = chunk->next;
+        if (next && next->cap >= size + ARENA_ALIGNMENT)
+        {
+            next->used = 0;
+            arena->current = next;
+            return arena_alloc(arena, size);
+        }
+    }
+
+    size_t cap = arena->chunk_size;
+    if (cap < size + ARENA_ALIGNMENT)
+        cap = size + ARENA_ALIGNMENT;
+
+    Arena_Chunk* new_chunk = (Arena_Chunk*) container_malloc(sizeof(Arena_Chunk) + cap);
+    hd_assert(new_chunk != NULL);
+
+    new_chunk->cap  = cap;
+    new_chunk->used = 0;
+
+    // Goes right after current so the chunks after it can still be reused
+    if (chunk)
+    {
+        new_chunk->next = chunk->next;
+        chunk->next = new_chunk;
+    }
+    else
+    {
+        new_chunk->next = arena->first;
+        arena->first = new_chunk;
+    }
+
+    arena->current = new_chunk;
+    return arena_alloc(arena, size);
+}
+
+// Copies n chars and adds a '\0', str doesn't have to be NUL terminated
+char* arena_copy_string(Arena* arena, const char* str, size_t n)
+{
+    char* copy = (char*) arena_alloc(arena, n + 1);
+    memcpy(copy, str, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+Arena_Mark arena_mark(Arena* arena)
+{
+    Arena_Mark mark = { arena->current, arena->current ? arena->current->used : 0 };
+    return mark;
+}
+
+void arena_rewind(Arena* arena, Arena_Mark mark)
+{
+    if (!mark.chunk)
+    {
+        arena_reset(arena);
+        return;
+    }
+
+    arena->current = mark.chunk;
+    mark.chunk->used = mark.used;
+}
+
+void arena_absorb(Arena* arena, Arena* other)
+{
+    if (!other->first)
+        return;
+
+    // Chunks left over from a reset don't hold anything
+    Arena_Chunk* last = other->current;
+    Arena_Chunk* leftover = last->next;
+    while (leftover)
+    {
+        Arena_Chunk* next = leftover->next;
+        free(leftover);
+        leftover = next;
+    }
+
+    // In front of first, everything before current is in use and isn't
+    // handed out again till a reset
+    last->next   = arena->first;
+    arena->first = other->first;
+
+    if (!arena->current)
+        arena->current = last;
+
+    other->first = other->current = NULL;
+}
+
+#endif // ARENA_IMPLEMENTED
+
+#endif // ARENA_IMPL
\ No newline at end of file
@@ -20,6 +20,9 @@
         #define CONTAINER_NO_ASSERT
     before creating the implemenation.
 
+    Allocations go through alloc_count.h, its implementation has to be
+    created somewhere too.
+
     Example:
         #define DARRAY_IMPL
         #define DARRAY_START_CAP 5
@@ -32,6 +35,8 @@
 #ifndef DARRAY_H
 #define DARRAY_H
 
+#include <stddef.h>
+
 #ifndef DARRAY_GROWTH_RATE
 #define DARRAY_GROWTH_RATE 1.5
 #endif // DARRAY_GROWTH_RATE
@@ -58,10 +63,13 @@
 #define da_cap(arr)                  da_cap_impl((void*)arr)
 
 #define da_push_back(arr, value)     da_push_back_impl(arr, value)
+#define da_append(arr, values, n)    da_append_impl((void**)&arr, values, n, sizeof(*arr))
 #define da_pop_back(arr)             da_pop_back_impl(arr)
 #define da_insert(arr, index, value) da_insert_impl(arr, index, value)
 #define da_erase_at(arr, index)      da_erase_at_impl(arr, index)
 #define da_erase_swap(arr, index)    da_erase_swap_impl(arr, index)
+#define da_clear(arr)                da_clear_impl(arr)
+#define da_truncate(arr, n)          da_truncate_impl(arr, n)
 
 #define da_foreach(type, it, arr)    for (DA_Itr(type) it = (DA_Itr(type))da_begin(arr); it != (DA_Itr(type))da_end(arr); it++)
 
@@ -71,6 +79,7 @@ void da_move_impl(void** dest, void** src, size_t type_size);
 void da_free_impl(void** arr);
 
 void da_resize_impl(void** arr, size_t new_cap, size_t type_size);
+void da_append_impl(void** arr, const void* values, size_t n, size_t type_size);
 
 DA_Itr(void) da_get_itr_impl(void* arr, size_t index, size_t type_size);
 
@@ -124,16 +133,16 @@ typedef struct
     } while(0)
 
 #define da_erase_at_impl(arr, index) \
-    do {                                        \
-        hd_assert(arr != NULL);                 \
-        DA_Internal* da = da_data(arr);         \
-        size_t size = da->size;                 \
-        hd_assert(size > 0 && index < size);    \
-                                                \
-        for (int i = index; i < size - 1; i++)  \
-            arr[i] = arr[i + 1];                \
-                                                \
-        da->size--;                             \
+    do {                                                \
+        hd_assert(arr != NULL);                         \
+        DA_Internal* da = da_data(arr);                 \
+        size_t size = da->size;                         \
+        hd_assert(size > 0 && (size_t) (index) < size); \
+                                                        \
+        for (size_t i = (index); i + 1 < size; i++)     \
+            arr[i] = arr[i + 1];                        \
+                                                        \
+        da->size--;                                     \
     } while(0)
 
 #define da_erase_swap_impl(arr, index) \
@@ -147,6 +156,21 @@ typedef struct
         da->size--;                             \
     } while(0)
 
+// Keeps the capacity around for reuse
+#define da_clear_impl(arr) \
+    do {                                    \
+        hd_assert(arr != NULL);             \
+        da_data(arr)->size = 0;             \
+    } while(0)
+
+// Keeps the first n values
+#define da_truncate_impl(arr, n) \
+    do {                                            \
+        hd_assert(arr != NULL);                     \
+        hd_assert((size_t) (n) <= da_size(arr));    \
+        da_data(arr)->size = (n);                   \
+    } while(0)
+
 #endif // DARRAY_H
 
 #ifdef DARRAY_IMPL
@@ -165,11 +189,12 @@ typedef struct
 #include <stdlib.h>
 #include <string.h>
 #include "hd_assert.h"
+#include "alloc_count.h"
 
 void da_make_impl(void** arr, size_t cap, size_t type_size)
 {
     size_t byte_size = cap * type_size + sizeof(DA_Internal);
-    DA_Internal* da = (DA_Internal*) malloc(byte_size);
+    DA_Internal* da = (DA_Internal*) container_malloc(byte_size);
     hd_assert(da != NULL);
 
     da->cap  = cap;
@@ -185,8 +210,8 @@ void da_copy_impl(void** dest, void* src, size_t type_size)
     size_t byte_size = src_da->cap * type_size + sizeof(DA_Internal);
     
     DA_Internal* dest_da;
-    if (*dest) dest_da = (DA_Internal*) realloc(da_data(*dest), byte_size);
-    else       dest_da = (DA_Internal*) malloc(byte_size);
+    if (*dest) dest_da = (DA_Internal*) container_realloc(da_data(*dest), byte_size);
+    else       dest_da = (DA_Internal*) container_malloc(byte_size);
 
     hd_assert(dest_da != NULL);
     
@@ -226,7 +251,7 @@ void da_resize_impl(void** arr, size_t new_cap, size_t type_size)
     }
 
     size_t byte_size = new_cap * type_size + sizeof(DA_Internal);
-    DA_Internal* new_da = (DA_Internal*) realloc(da, byte_size);
+    DA_Internal* new_da = (DA_Internal*) container_realloc(da, byte_size);
     
     new_da->size = size;
     new_da->cap  = new_cap;
@@ -234,6 +259,26 @@ void da_resize_impl(void** arr, size_t new_cap, size_t type_size)
     *arr = new_da->buffer;
 }
 
+// Grows like push_back does, so appending in a loop stays amortized
+void da_append_impl(void** arr, const void* values, size_t n, size_t type_size)
+{
+    hd_assert(*arr != NULL);
+    DA_Internal* da = da_data(*arr);
+
+    if (da->size + n > da->cap)
+    {
+        size_t new_cap = (size_t) (DARRAY_GROWTH_RATE * da->cap);
+        if (new_cap < da->size + n)
+            new_cap = da->size + n;
+
+        da_resize_impl(arr, new_cap, type_size);
+        da = da_data(*arr);
+    }
+
+    memcpy(da->buffer + da->size * type_size, values, n * type_size);
+    da->size += n;
+}
+
 DA_Itr(void) da_get_itr_impl(void* arr, size_t index, size_t type_size)
 {
     hd_assert(arr != NULL);
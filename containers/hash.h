@@ -0,0 +1,142 @@
+/*
+    PURE C HASH FUNCTION
+    64 bit xxHash (XXH64). Reads 8 bytes at a time and has good distribution
+    in the low bits, so tables can mask instead of taking a modulo.
+
+    To create the implementaion use:
+        #define HASH_IMPL
+    before you include this file in *one* C or C++ file.
+
+    Example:
+        #define HASH_IMPL
+        #include "containers/hash.h"
+
+        uint64_t h = hash_bytes("INT. HOUSE", 10, 0);
+*/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed);
+uint64_t hash_string(const char* str);
+
+#endif // HASH_H
+
+#ifdef HASH_IMPL
+
+#ifndef HASH_IMPLEMENTED
+#define HASH_IMPLEMENTED
+
+#include <string.h>
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+#define hash_rotl(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+// memcpy so unaligned reads are fine, compilers turn these into a single load
+static uint64_t hash_read64(const unsigned char* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash_read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * HASH_PRIME_2;
+    acc  = hash_rotl(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+static uint64_t hash_merge_round(uint64_t acc, uint64_t value)
+{
+    acc ^= hash_round(0, value);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed)
+{
+    const unsigned char* p   = (const unsigned char*) data;
+    const unsigned char* end = p + length;
+    uint64_t h;
+
+    if (length >= 32)
+    {
+        uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+        uint64_t v2 = seed + HASH_PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH_PRIME_1;
+
+        // 4 independent lanes of 8 bytes each
+        do
+        {
+            v1 = hash_round(v1, hash_read64(p));      p += 8;
+            v2 = hash_round(v2, hash_read64(p));      p += 8;
+            v3 = hash_round(v3, hash_read64(p));      p += 8;
+            v4 = hash_round(v4, hash_read64(p));      p += 8;
+        } while (p + 32 <= end);
+
+        h = hash_rotl(v1, 1) + hash_rotl(v2, 7) + hash_rotl(v3, 12) + hash_rotl(v4, 18);
+        h = hash_merge_round(h, v1);
+        h = hash_merge_round(h, v2);
+        h = hash_merge_round(h, v3);
+        h = hash_merge_round(h, v4);
+    }
+    else
+    {
+        h = seed + HASH_PRIME_5;
+    }
+
+    h += (uint64_t) length;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= hash_round(0, hash_read64(p));
+        h  = hash_rotl(h, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t) hash_read32(p) * HASH_PRIME_1;
+        h  = hash_rotl(h, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        h ^= (*p) * HASH_PRIME_5;
+        h  = hash_rotl(h, 11) * HASH_PRIME_1;
+    }
+
+    // Avalanche so every input bit affects every output bit
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+uint64_t hash_string(const char* str)
+{
+    return hash_bytes(str, strlen(str), 0);
+}
+
+#endif // HASH_IMPLEMENTED
+
+#endif // HASH_IMPL
\ No newline at end of file
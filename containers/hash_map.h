@@ -0,0 +1,395 @@
+/*
+    PURE C HASH MAP
+    Open addressing map from strings to values, laid out like a Swiss table.
+    Every slot has a control byte that's either empty, deleted or the low 7
+    bits of the key's hash. Lookups check a group of 16 control bytes at once
+    (with SSE2 when it's there) and only look at keys whose bits match. Full
+    hashes are stored next to the keys so growing never rehashes a string.
+
+    Keys aren't copied, the map only points at them. They have to stay alive
+    and unchanged while they're in the map, an arena is a good place for them.
+
+    Depends on hash.h and alloc_count.h, their implementations have to be
+    created somewhere too.
+
+    To create the implementaion use:
+        #define HASH_MAP_IMPL
+    before you include this file in *one* C or C++ file.
+
+    The map starts empty and allocates MAP_START_CAP slots on the first put,
+    the capacity doubles when more than 7/8 of the slots are taken.
+    Starting capacity can be changed by using:
+        #define MAP_START_CAP <value>
+    before creating the implementation, it has to be a power of two and at
+    least MAP_GROUP_SIZE.
+
+    The SSE2 group matching can be turned off with:
+        #define MAP_NO_SIMD
+    before creating the implementation.
+
+    Assertions in the implementation can be removed by using:
+        #define CONTAINER_NO_ASSERT
+    before creating the implemenation.
+
+    Example:
+        #define HASH_MAP_IMPL
+        #include "containers/hash_map.h"
+
+        Map(int) ages;
+        map_make(ages);
+        map_put(ages, "Joe", 3, 42);
+
+        int* age = map_find_str(ages, "Joe");   // NULL if it isn't there
+        map_foreach(ages, i)
+            printf("%s %d\n", map_key(ages, i).str, *map_value(ages, i));
+
+        map_free(ages);
+*/
+
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef MAP_START_CAP
+#define MAP_START_CAP 16
+#endif // MAP_START_CAP
+
+#define MAP_GROUP_SIZE 16
+
+#define MAP_CTRL_EMPTY   ((uint8_t) 0x80)
+#define MAP_CTRL_DELETED ((uint8_t) 0xFE)
+
+typedef struct _Map_Key
+{
+    const char* str;
+    int length;
+    uint64_t hash;
+} Map_Key;
+
+typedef struct _Map_Internal
+{
+    uint8_t* ctrl;      // cap bytes, high bit set means empty or deleted
+    Map_Key* keys;
+    char*    values;    // cap * value_size bytes
+    size_t value_size;
+
+    size_t cap;         // Power of two, 0 until the first put
+    size_t count;
+    size_t growth_left; // Empty slots that can be filled before growing
+} Map_Internal;
+
+// tag is never read, it carries the value type and is used to cast results
+#define Map(type) \
+    struct              \
+    {                   \
+        Map_Internal m; \
+        type* tag;      \
+    }
+
+#define map_make(map)                   map_make_impl(&(map).m, sizeof(*(map).tag))
+#define map_free(map)                   map_free_impl(&(map).m)
+#define map_clear(map)                  map_clear_impl(&(map).m)
+
+// Pointer to the value or NULL
+#define map_find(map, str, length)      ((map).tag = map_find_impl(&(map).m, str, length))
+#define map_find_str(map, str)          ((map).tag = map_find_impl(&(map).m, str, strlen(str)))
+
+// Inserts or overwrites
+#define map_put(map, str, length, value) (*((map).tag = map_insert_impl(&(map).m, str, length, NULL)) = (value))
+
+// Pointer to the value, it's zeroed if the key was just added
+#define map_insert(map, str, length, is_new) ((map).tag = map_insert_impl(&(map).m, str, length, is_new))
+
+#define map_remove(map, str, length)    map_remove_impl(&(map).m, str, length)
+
+#define map_count(map)                  ((map).m.count)
+#define map_cap(map)                    ((map).m.cap)
+
+// Slots, skip the ones map_slot_full says are empty. map_foreach does that.
+#define map_slot_full(map, i)           (((map).m.ctrl[i] & 0x80) == 0)
+#define map_key(map, i)                 ((map).m.keys[i])
+#define map_value(map, i)               ((map).tag = (void*) ((map).m.values + (i) * (map).m.value_size))
+
+#define map_foreach(map, i) \
+    for (size_t i = 0; i < (map).m.cap; i++) \
+        if (map_slot_full(map, i))
+
+void  map_make_impl(Map_Internal* map, size_t value_size);
+void  map_free_impl(Map_Internal* map);
+void  map_clear_impl(Map_Internal* map);
+void* map_find_impl(Map_Internal* map, const char* str, size_t length);
+void* map_insert_impl(Map_Internal* map, const char* str, size_t length, int* is_new);
+int   map_remove_impl(Map_Internal* map, const char* str, size_t length);
+
+#endif // HASH_MAP_H
+
+#ifdef HASH_MAP_IMPL
+
+#ifndef HASH_MAP_IMPLEMENTED
+#define HASH_MAP_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hd_assert.h"
+#include "alloc_count.h"
+
+#if !defined(MAP_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MAP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int map_first_bit(uint32_t bits)
+{
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (int) index;
+}
+#else
+#define map_first_bit(bits) __builtin_ctz(bits)
+#endif
+
+/*
+    Map memory layout, one allocation:
+    [ctrl * cap][pad][keys * cap][values * cap]
+
+    Probing goes over groups of MAP_GROUP_SIZE slots, starting at the group
+    picked by the high bits of the hash and stepping 1, 2, 3... groups, which
+    visits every group once when the group count is a power of two.
+*/
+
+#define map_h1(hash) ((size_t) ((hash) >> 7))
+#define map_h2(hash) ((uint8_t) ((hash) & 0x7F))
+
+// Bit i is set if ctrl[i] == byte
+static uint32_t map_match_byte(const uint8_t* ctrl, uint8_t byte)
+{
+#ifdef MAP_USE_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*) ctrl);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte)));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < MAP_GROUP_SIZE; i++)
+        bits |= (uint32_t) (ctrl[i] == byte) << i;
+    return bits;
+#endif
+}
+
+// Bit i is set if ctrl[i] is empty or deleted, those are the ones with the high bit
+static uint32_t map_match_free(const uint8_t* ctrl)
+{
+#ifdef MAP_USE_SSE2
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) ctrl));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < MAP_GROUP_SIZE; i++)
+        bits |= (uint32_t) (ctrl[i] >> 7) << i;
+    return bits;
+#endif
+}
+
+static size_t map_keys_offset(size_t cap)
+{
+    // Keep the keys 8 byte aligned after the control bytes
+    return (cap + 7) & ~(size_t) 7;
+}
+
+static void map_allocate(Map_Internal* map, size_t cap)
+{
+    size_t keys_offset   = map_keys_offset(cap);
+    size_t values_offset = keys_offset + cap * sizeof(Map_Key);
+
+    char* block = (char*) container_malloc(values_offset + cap * map->value_size);
+    hd_assert(block != NULL);
+
+    map->ctrl   = (uint8_t*) block;
+    map->keys   = (Map_Key*) (block + keys_offset);
+    map->values = block + values_offset;
+    map->cap    = cap;
+    map->count  = 0;
+    map->growth_left = cap - cap / 8;
+
+    memset(map->ctrl, MAP_CTRL_EMPTY, cap);
+}
+
+void map_make_impl(Map_Internal* map, size_t value_size)
+{
+    memset(map, 0, sizeof(*map));
+    map->value_size = value_size;
+}
+
+void map_free_impl(Map_Internal* map)
+{
+    free(map->ctrl);
+
+    size_t value_size = map->value_size;
+    memset(map, 0, sizeof(*map));
+    map->value_size = value_size;
+}
+
+// Keeps the capacity around for reuse
+void map_clear_impl(Map_Internal* map)
+{
+    if (!map->ctrl)
+        return;
+
+    memset(map->ctrl, MAP_CTRL_EMPTY, map->cap);
+    map->count = 0;
+    map->growth_left = map->cap - map->cap / 8;
+}
+
+// Slot index of the key, or cap if it isn't there
+static size_t map_find_slot(Map_Internal* map, const char* str, size_t length, uint64_t hash)
+{
+    if (!map->ctrl)
+        return map->cap;
+
+    size_t group_mask = map->cap / MAP_GROUP_SIZE - 1;
+    size_t group = map_h1(hash) & group_mask;
+
+    for (size_t step = 1; ; step++)
+    {
+        const uint8_t* ctrl = map->ctrl + group * MAP_GROUP_SIZE;
+
+        for (uint32_t bits = map_match_byte(ctrl, map_h2(hash)); bits; bits &= bits - 1)
+        {
+            size_t i = group * MAP_GROUP_SIZE + map_first_bit(bits);
+            Map_Key* key = map->keys + i;
+
+            if (key->hash == hash && (size_t) key->length == length && memcmp(key->str, str, length) == 0)
+                return i;
+        }
+
+        // An empty slot ends the probe, the key would have gone there
+        if (map_match_byte(ctrl, MAP_CTRL_EMPTY))
+            return map->cap;
+
+        // Every group was checked, only possible when it's full of deleted slots
+        if (step > group_mask)
+            return map->cap;
+
+        group = (group + step) & group_mask;
+    }
+}
+
+// First empty or deleted slot on the probe sequence of hash
+static size_t map_find_free_slot(Map_Internal* map, uint64_t hash)
+{
+    size_t group_mask = map->cap / MAP_GROUP_SIZE - 1;
+    size_t group = map_h1(hash) & group_mask;
+
+    for (size_t step = 1; ; step++)
+    {
+        uint32_t bits = map_match_free(map->ctrl + group * MAP_GROUP_SIZE);
+        if (bits)
+            return group * MAP_GROUP_SIZE + map_first_bit(bits);
+
+        group = (group + step) & group_mask;
+    }
+}
+
+static void map_resize(Map_Internal* map, size_t new_cap)
+{
+    Map_Internal old = *map;
+    map_allocate(map, new_cap);
+
+    for (size_t i = 0; i < old.cap; i++)
+    {
+        if (old.ctrl[i] & 0x80)
+            continue;
+
+        // Stored hashes, no need to look at the strings again
+        size_t slot = map_find_free_slot(map, old.keys[i].hash);
+        map->ctrl[slot] = old.ctrl[i];
+        map->keys[slot] = old.keys[i];
+        memcpy(map->values + slot * map->value_size, old.values + i * map->value_size, map->value_size);
+    }
+
+    map->count = old.count;
+    map->growth_left -= old.count;
+
+    free(old.ctrl);
+}
+
+void* map_find_impl(Map_Internal* map, const char* str, size_t length)
+{
+    uint64_t hash = hash_bytes(str, length, 0);
+    size_t slot = map_find_slot(map, str, length, hash);
+
+    if (slot == map->cap)
+        return NULL;
+
+    return map->values + slot * map->value_size;
+}
+
+void* map_insert_impl(Map_Internal* map, const char* str, size_t length, int* is_new)
+{
+    uint64_t hash = hash_bytes(str, length, 0);
+    size_t slot = map_find_slot(map, str, length, hash);
+
+    if (is_new)
+        *is_new = (slot == map->cap);
+
+    if (slot != map->cap)
+        return map->values + slot * map->value_size;
+
+    if (!map->ctrl)
+        map_allocate(map, MAP_START_CAP);
+
+    slot = map_find_free_slot(map, hash);
+
+    // Reusing a deleted slot doesn't take away from the growth left
+    if (map->ctrl[slot] == MAP_CTRL_EMPTY)
+    {
+        if (map->growth_left == 0)
+        {
+            // Lots of deleted slots get cleaned up by rehashing at the same size
+            map_resize(map, (map->count * 2 >= map->cap) ? map->cap * 2 : map->cap);
+            slot = map_find_free_slot(map, hash);
+        }
+
+        map->growth_left--;
+    }
+
+    map->ctrl[slot] = map_h2(hash);
+    map->keys[slot] = (Map_Key) { str, (int) length, hash };
+    map->count++;
+
+    void* value = map->values + slot * map->value_size;
+    memset(value, 0, map->value_size);
+    return value;
+}
+
+int map_remove_impl(Map_Internal* map, const char* str, size_t length)
+{
+    uint64_t hash = hash_bytes(str, length, 0);
+    size_t slot = map_find_slot(map, str, length, hash);
+
+    if (slot == map->cap)
+        return 0;
+
+    // If the group still has an empty slot no probe ever went past it,
+    // so the slot can be empty again instead of a tombstone
+    const uint8_t* group = map->ctrl + (slot & ~(size_t) (MAP_GROUP_SIZE - 1));
+    if (map_match_byte(group, MAP_CTRL_EMPTY))
+    {
+        map->ctrl[slot] = MAP_CTRL_EMPTY;
+        map->growth_left++;
+    }
+    else
+    {
+        map->ctrl[slot] = MAP_CTRL_DELETED;
+    }
+
+    map->count--;
+    return 1;
+}
+
+#endif // HASH_MAP_IMPLEMENTED
+
+#endif // HASH_MAP_IMPL
\ No newline at end of file
@@ -3,6 +3,10 @@
 
 #include <stdio.h>
 
+#if !defined(_MSC_VER) && !defined(__debugbreak)
+#define __debugbreak() __builtin_trap()
+#endif
+
 #ifndef CONTAINER_NO_ASSERT
 #define hd_assert(x) if (!(x)) { printf("Assertion Failed: %s \nLocation %s:%d", #x, __FILE__, __LINE__); __debugbreak(); }
 #else
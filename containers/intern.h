@@ -0,0 +1,111 @@
+/*
+    PURE C STRING INTERNING
+    Gives every distinct string a small int id, the same string always gets
+    the same id. The strings are copied into an arena once and ids index
+    into an array, so comparing interned strings is comparing ints.
+
+    Depends on arena.h, darray.h, hash.h and hash_map.h, their implementations
+    have to be created somewhere too.
+
+    To create the implementaion use:
+        #define INTERN_IMPL
+    before you include this file in *one* C or C++ file.
+
+    Example:
+        #define INTERN_IMPL
+        #include "containers/intern.h"
+
+        Intern_Table table = intern_make(&arena);
+        int id = intern(&table, "DAY", 3, NULL);
+        intern_get(table, id).str;  // "DAY"
+        intern_free(&table);
+*/
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include "arena.h"
+#include "darray.h"
+#include "hash_map.h"
+
+typedef struct _Interned
+{
+    const char* str;    // NUL terminated, in the arena
+    int length;
+} Interned;
+
+typedef struct _Intern_Table
+{
+    Arena* arena;
+    DArray(Interned) strings;   // Indexed by id
+    Map(int) ids;               // Keys are the strings above
+} Intern_Table;
+
+#define intern_get(table, id) ((table).strings[id])
+#define intern_count(table)   ((int) da_size((table).strings))
+
+Intern_Table intern_make(Arena* arena);
+void intern_free(Intern_Table* table);
+void intern_clear(Intern_Table* table);    // The strings stay in the arena till it's reset
+
+int intern(Intern_Table* table, const char* str, int length, int* is_new);    // is_new can be NULL
+int intern_find(Intern_Table* table, const char* str, int length);           // -1 if not there
+
+#endif // INTERN_H
+
+#ifdef INTERN_IMPL
+
+#ifndef INTERN_IMPLEMENTED
+#define INTERN_IMPLEMENTED
+
+Intern_Table intern_make(Arena* arena)
+{
+    Intern_Table table = { 0 };
+    table.arena = arena;
+
+    da_make(table.strings);
+    map_make(table.ids);
+    return table;
+}
+
+void intern_free(Intern_Table* table)
+{
+    da_free(table->strings);
+    map_free(table->ids);
+}
+
+void intern_clear(Intern_Table* table)
+{
+    da_clear(table->strings);
+    map_clear(table->ids);
+}
+
+int intern_find(Intern_Table* table, const char* str, int length)
+{
+    int* id = map_find(table->ids, str, length);
+    return id ? *id : -1;
+}
+
+int intern(Intern_Table* table, const char* str, int length, int* is_new)
+{
+    int id = intern_find(table, str, length);
+
+    if (is_new)
+        *is_new = (id < 0);
+
+    if (id >= 0)
+        return id;
+
+    // The map keeps pointing at the key, so it has to be the arena copy
+    Interned s = { arena_copy_string(table->arena, str, length), length };
+    id = intern_count(*table);
+
+    da_push_back(table->strings, s);
+    map_put(table->ids, s.str, length, id);
+    return id;
+}
+
+#endif // INTERN_IMPLEMENTED
+
+#endif // INTERN_IMPL
\ No newline at end of file
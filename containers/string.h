@@ -1,6 +1,8 @@
 #ifndef CONTAINER_STRING_H
 #define CONTAINER_STRING_H
 
+#include <stddef.h>
+
 typedef char* String;
 
 String string_make(char* cstr);
@@ -14,8 +16,8 @@ void   string_replace(String* str, char* cstr);
 String string_get_line(String contents, size_t* index);
 void   string_resize(String* str, size_t new_len);
 
-inline size_t string_length(String str);
-inline int    string_cmp(String s1, String s2);
+size_t string_length(String str);
+int    string_cmp(String s1, String s2);
 
 void string_append(String* dest, char* other);
 void string_to_lower(String* str);
@@ -32,6 +34,7 @@ void string_to_lower(String* str);
 #include <string.h>
 
 #include "hd_assert.h"
+#include "alloc_count.h"
 
 typedef struct
 {
@@ -44,7 +47,7 @@ typedef struct
 String string_make(char* cstr)
 {
     size_t len = strlen(cstr) + 1;
-    String_Internal* s = (String_Internal*) malloc(len * sizeof(char) + sizeof(String_Internal));
+    String_Internal* s = (String_Internal*) container_malloc(len * sizeof(char) + sizeof(String_Internal));
     hd_assert(s != NULL);
     
     s->length = len;
@@ -59,8 +62,8 @@ void string_copy(String* dest, String src)
     size_t byte_size = (src_str->length + 1) * sizeof(char) + sizeof(String_Internal);
     
     String_Internal* dest_str;
-    if (*dest) dest_str = (String_Internal*) realloc(string_data(*dest), byte_size);
-    else       dest_str = (String_Internal*) malloc(byte_size);
+    if (*dest) dest_str = (String_Internal*) container_realloc(string_data(*dest), byte_size);
+    else       dest_str = (String_Internal*) container_malloc(byte_size);
 
     hd_assert(dest_str != NULL);
     dest_str->length = src_str->length;
@@ -86,7 +89,7 @@ String string_make_till_char(char* cstr, char delim)
 
     size_t len = end - cstr;
     size_t byte_size = len * sizeof(char) + sizeof(String_Internal);
-    String_Internal* s = (String_Internal*) malloc(byte_size);
+    String_Internal* s = (String_Internal*) container_malloc(byte_size);
     hd_assert(s != NULL);
 
     s->length = len;
@@ -97,10 +100,11 @@ String string_make_till_char(char* cstr, char delim)
 
 String string_make_till_n(char* cstr, size_t n)
 {
-    hd_assert(n < strlen(cstr) + 1);
+    // Same as n <= strlen(cstr) but doesn't read past n chars, so it works on unterminated buffers
+    hd_assert(memchr(cstr, '\0', n) == NULL);
 
     size_t byte_size = (n + 1) * sizeof(char) + sizeof(String_Internal);
-    String_Internal* s = (String_Internal*) malloc(byte_size);
+    String_Internal* s = (String_Internal*) container_malloc(byte_size);
     hd_assert(s != NULL);
 
     s->length = n + 1;
@@ -141,7 +145,7 @@ void string_replace(String* str, char* cstr)
     hd_assert(*str);
     size_t length = strlen(cstr);
     size_t byte_size = (length + 1) * sizeof(char) + sizeof(String_Internal);
-    String_Internal* s = (String_Internal*) realloc(string_data(*str), byte_size);
+    String_Internal* s = (String_Internal*) container_realloc(string_data(*str), byte_size);
 
     s->length = length;
     strcpy(s->buffer, cstr);
@@ -154,8 +158,8 @@ void string_resize(String* str, size_t new_len)
     size_t byte_size = (new_len + 1) * sizeof(char) + sizeof(String_Internal);
 
     String_Internal* s;
-    if (*str) s = (String_Internal*) realloc(string_data(*str), byte_size);
-    else      s = (String_Internal*) malloc(byte_size);
+    if (*str) s = (String_Internal*) container_realloc(string_data(*str), byte_size);
+    else      s = (String_Internal*) container_malloc(byte_size);
 
     hd_assert(s != NULL);
     s->length = new_len - 1;
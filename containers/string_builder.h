@@ -0,0 +1,217 @@
+/*
+    PURE C STRING BUILDER
+    A growable char buffer that keeps its length and capacity, so appending
+    doesn't rescan or reallocate the whole thing every time. The buffer is
+    always NUL terminated and can be used as a C string through sb.data.
+
+    To create the implementaion use:
+        #define STRING_BUILDER_IMPL
+    before you include this file in *one* C or C++ file.
+
+    Default growth rate is 2.
+    Growth rate of the builder can be changed by using:
+        #define STRING_BUILDER_GROWTH_RATE <value>
+    before creating the implementation to change growth rate to <value>.
+
+    Default starting capacity is 256.
+    Starting capacity can be changed by using:
+        #define STRING_BUILDER_START_CAP <value>
+    before creating the implementation, or per builder with sb_make.
+
+    sb_append_fmt doesn't go through printf. It knows %s, %c, %d, %u, %zu and %%.
+
+    Assertions in the implementation can be removed by using:
+        #define CONTAINER_NO_ASSERT
+    before creating the implemenation.
+
+    Allocations go through alloc_count.h, its implementation has to be
+    created somewhere too.
+
+    Example:
+        #define STRING_BUILDER_IMPL
+        #include "containers/string_builder.h"
+
+        String_Builder sb = sb_make(0);
+        sb_append(&sb, "Hello");
+        sb_append_fmt(&sb, ", %s #%d", "world", 1);
+        puts(sb.data);
+        sb_free(&sb);
+*/
+
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifndef STRING_BUILDER_GROWTH_RATE
+#define STRING_BUILDER_GROWTH_RATE 2
+#endif // STRING_BUILDER_GROWTH_RATE
+
+#ifndef STRING_BUILDER_START_CAP
+#define STRING_BUILDER_START_CAP 256
+#endif // STRING_BUILDER_START_CAP
+
+typedef struct _String_Builder
+{
+    char*  data;
+    size_t length;  // Not counting the '\0'
+    size_t cap;     // Same
+} String_Builder;
+
+String_Builder sb_make(size_t cap);     // 0 for STRING_BUILDER_START_CAP
+void sb_free(String_Builder* sb);
+void sb_clear(String_Builder* sb);
+void sb_reserve(String_Builder* sb, size_t extra);
+
+void sb_append(String_Builder* sb, const char* str);
+void sb_append_n(String_Builder* sb, const char* str, size_t n);
+void sb_append_char(String_Builder* sb, char ch);
+void sb_append_fmt(String_Builder* sb, const char* fmt, ...);
+void sb_append_fmtv(String_Builder* sb, const char* fmt, va_list args);
+
+#endif // STRING_BUILDER_H
+
+#ifdef STRING_BUILDER_IMPL
+
+#ifndef STRING_BUILDER_IMPLEMENTED
+#define STRING_BUILDER_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+#include "hd_assert.h"
+#include "alloc_count.h"
+
+String_Builder sb_make(size_t cap)
+{
+    String_Builder sb = { 0 };
+    sb.cap  = cap ? cap : STRING_BUILDER_START_CAP;
+    sb.data = (char*) container_malloc(sb.cap + 1);
+    hd_assert(sb.data != NULL);
+
+    sb.data[0] = '\0';
+    return sb;
+}
+
+void sb_free(String_Builder* sb)
+{
+    free(sb->data);
+    sb->data   = NULL;
+    sb->length = sb->cap = 0;
+}
+
+// Keeps the capacity around for reuse
+void sb_clear(String_Builder* sb)
+{
+    sb->length = 0;
+    if (sb->data)
+        sb->data[0] = '\0';
+}
+
+// Makes sure extra more chars fit without growing
+void sb_reserve(String_Builder* sb, size_t extra)
+{
+    if (sb->length + extra <= sb->cap && sb->data)
+        return;
+
+    size_t new_cap = sb->cap ? sb->cap : STRING_BUILDER_START_CAP;
+    while (new_cap < sb->length + extra)
+        new_cap *= STRING_BUILDER_GROWTH_RATE;
+
+    char* data = (char*) container_realloc(sb->data, new_cap + 1);
+    hd_assert(data != NULL);
+
+    sb->data = data;
+    sb->cap  = new_cap;
+}
+
+void sb_append_n(String_Builder* sb, const char* str, size_t n)
+{
+    sb_reserve(sb, n);
+    memcpy(sb->data + sb->length, str, n);
+    sb->length += n;
+    sb->data[sb->length] = '\0';
+}
+
+void sb_append(String_Builder* sb, const char* str)
+{
+    sb_append_n(sb, str, strlen(str));
+}
+
+void sb_append_char(String_Builder* sb, char ch)
+{
+    sb_append_n(sb, &ch, 1);
+}
+
+static void sb_append_unsigned(String_Builder* sb, size_t value)
+{
+    char digits[24];
+    int count = 0;
+
+    do
+    {
+        digits[sizeof(digits) - 1 - count++] = '0' + (char) (value % 10);
+        value /= 10;
+    } while (value);
+
+    sb_append_n(sb, digits + sizeof(digits) - count, count);
+}
+
+void sb_append_fmt(String_Builder* sb, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    sb_append_fmtv(sb, fmt, args);
+    va_end(args);
+}
+
+void sb_append_fmtv(String_Builder* sb, const char* fmt, va_list args)
+{
+    const char* last = fmt;
+    for (const char* at = strchr(fmt, '%'); at; at = strchr(last, '%'))
+    {
+        sb_append_n(sb, last, at - last);
+        at++;
+
+        // A lone '%' at the end
+        if (*at == '\0')
+        {
+            last = at;
+            break;
+        }
+
+        switch (*at)
+        {
+            case 's': sb_append(sb, va_arg(args, const char*)); break;
+            case 'c': sb_append_char(sb, (char) va_arg(args, int)); break;
+            case 'u': sb_append_unsigned(sb, va_arg(args, unsigned int)); break;
+            case '%': sb_append_char(sb, '%'); break;
+
+            case 'd':
+            {
+                int value = va_arg(args, int);
+                if (value < 0)
+                    sb_append_char(sb, '-');
+
+                sb_append_unsigned(sb, (value < 0) ? -(size_t) value : (size_t) value);
+            } break;
+
+            case 'z':
+            {
+                hd_assert(at[1] == 'u');
+                sb_append_unsigned(sb, va_arg(args, size_t));
+                at++;
+            } break;
+
+            default: hd_assert(0 && "Unsupported format");
+        }
+
+        last = at + 1;
+    }
+
+    sb_append(sb, last);
+}
+
+#endif // STRING_BUILDER_IMPLEMENTED
+
+#endif // STRING_BUILDER_IMPL
\ No newline at end of file
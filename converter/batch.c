@@ -0,0 +1,672 @@
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "filestuff.h"
+#include "fountain.h"
+#include "fdx.h"
+#include "helpers.h"
+#include "queue.h"
+#include "sink.h"
+#include "threads.h"
+#include "containers/arena.h"
+#include "containers/hd_assert.h"
+
+#define BATCH_MAX_THREADS 64
+
+// Files in flight per pipeline thread, every one of them holds an input and its output
+#define PIPELINE_ITEMS_PER_THREAD 2
+// How many files ahead of the one being read readers ask the OS to prefetch
+#define PIPELINE_PREFETCH_AHEAD 4
+
+Batch batch_make(void)
+{
+    Batch batch = { 0 };
+    da_make(batch.jobs);
+    return batch;
+}
+
+void batch_free(Batch* batch)
+{
+    da_foreach(Batch_Job, job, batch->jobs)
+    {
+        string_free(&job->input);
+        string_free(&job->output);
+    }
+
+    da_free(batch->jobs);
+}
+
+static void add_file(void* user, const char* filepath, size_t size)
+{
+    Batch* batch = (Batch*) user;
+    if (!is_fountain((char*) filepath))
+        return;
+
+    Batch_Job job;
+    job.input  = string_make((char*) filepath);
+    job.output = convert_extension((char*) filepath);
+    job.size   = size;
+    da_push_back(batch->jobs, job);
+}
+
+int batch_add_path(Batch* batch, const char* path)
+{
+    int is_directory;
+    size_t size;
+    if (!path_info(path, &is_directory, &size))
+    {
+        batch->missing++;
+        return 0;
+    }
+
+    if (is_directory)
+        return walk_directory(path, add_file, batch);
+
+    add_file(batch, path, size);
+    return 1;
+}
+
+int batch_add_manifest(Batch* batch, const char* filepath)
+{
+    File_View manifest;
+    if (!load_file(filepath, &manifest))
+    {
+        batch->missing++;
+        return 0;
+    }
+
+    // Can't go through string_get_line, the view isn't NUL terminated
+    char path[4096];
+    size_t at = 0;
+    while (at < manifest.size)
+    {
+        size_t end = at;
+        while (end < manifest.size && manifest.data[end] != '\n')
+            end++;
+
+        size_t length = end - at;
+        while (length > 0 && (manifest.data[at + length - 1] == '\r' || manifest.data[at + length - 1] == ' '))
+            length--;
+
+        if (length > 0 && length < sizeof(path) && manifest.data[at] != '#')
+        {
+            memcpy(path, manifest.data + at, length);
+            path[length] = '\0';
+
+            if (!batch_add_path(batch, path))
+                printf("Couldn't read \"%s\"\n", path);
+        }
+
+        at = end + 1;
+    }
+
+    unload_file(&manifest);
+    return 1;
+}
+
+static double cpu_clock(void)
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+
+    ULARGE_INTEGER k = { { kernel.dwLowDateTime, kernel.dwHighDateTime } };
+    ULARGE_INTEGER u = { { user.dwLowDateTime, user.dwHighDateTime } };
+    return (double) (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+/*
+    Work stealing
+    The jobs are sorted largest first and dealt out to the threads like
+    cards, so every thread's queue is largest first too. A thread takes from
+    the front of its own queue, and once that's empty it steals from the
+    front of whichever queue has the most left. Taking is a single atomic
+    add on the queue's head, the queues never grow so that's all the
+    synchronization there is.
+*/
+
+typedef struct _Batch_Queue
+{
+    int* jobs;      // Indices into batch->jobs
+    int head;       // Can go past count, that means empty
+    int count;
+} Batch_Queue;
+
+typedef struct _Batch_Worker
+{
+    Batch_Queue queue;
+    Batch_Summary totals;
+} Batch_Worker;
+
+typedef struct _Batch_Run
+{
+    Batch* batch;
+    Batch_Worker* workers;
+    int count;
+    int next_worker;    // Hands every thread its own worker
+} Batch_Run;
+
+static int queue_take(Batch_Queue* queue)
+{
+    int at = atomic_fetch_add_int(&queue->head, 1);
+    return (at < queue->count) ? queue->jobs[at] : -1;
+}
+
+static int take_job(Batch_Run* run, Batch_Worker* self)
+{
+    int job = queue_take(&self->queue);
+
+    while (job < 0)
+    {
+        // Steal from the fullest queue, nothing left anywhere means done
+        Batch_Worker* victim = NULL;
+        int most = 0;
+
+        for (int i = 0; i < run->count; i++)
+        {
+            Batch_Queue* queue = &run->workers[i].queue;
+            int left = queue->count - atomic_load_int(&queue->head);
+            if (left > most)
+            {
+                most = left;
+                victim = run->workers + i;
+            }
+        }
+
+        if (!victim)
+            return -1;
+
+        job = queue_take(&victim->queue);
+    }
+
+    return job;
+}
+
+// Puts the input's fdx in rendered, a memory sink, straight out of the cache
+// if it's there. Returns 1 for a hit.
+static int render_job(Fdx_Cache* cache, File_View* input, Parser* parser, Sink* rendered)
+{
+    sb_clear(&rendered->buffer);
+
+    uint64_t key = 0;
+    if (cache)
+    {
+        key = cache_key(input->data, input->size);
+
+        File_View hit;
+        if (cache_load(cache, key, &hit))
+        {
+            sb_append_n(&rendered->buffer, hit.data, hit.size);
+            unload_file(&hit);
+            return 1;
+        }
+    }
+
+    parser_reset(parser, input->data, input->size);
+    parser_parse(parser);
+    render_fdx(parser, rendered);
+
+    // Not being able to store it only costs a parse next time
+    if (cache)
+        cache_store(cache, key, rendered->buffer.data, rendered->buffer.length);
+
+    return 0;
+}
+
+static int write_rendered(Batch_Job* job, String_Builder* rendered, Batch_Summary* totals)
+{
+    int changed;
+    if (!write_file_if_changed(job->output, rendered->data, rendered->length, &changed))
+        return 0;
+
+    if (changed)
+        totals->bytes_written += rendered->length;
+    else
+        totals->unchanged++;
+
+    return 1;
+}
+
+// The parser and the sink's buffer are the worker's, only the input and output change
+static void convert_job(Batch* batch, Batch_Job* job, Parser* parser, Sink* sink, Batch_Summary* totals)
+{
+    totals->files++;
+
+    File_View input;
+    if (!load_file(job->input, &input))
+    {
+        printf("Couldn't read file \"%s\"\n", job->input);
+        totals->failed++;
+        return;
+    }
+
+    int written;
+    if (batch->cache)
+    {
+        // sink is a memory sink here
+        totals->cached += render_job(batch->cache, &input, parser, sink);
+        written = write_rendered(job, &sink->buffer, totals);
+    }
+    else
+    {
+        // Nothing needs the elements afterwards, they're written as they're parsed
+        written = sink_reopen_file(sink, job->output);
+        if (written)
+        {
+            parser_reset(parser, input.data, input.size);
+            stream_fdx(parser, sink);
+            written = sink_close_file(sink);
+        }
+    }
+
+    totals->bytes_read += input.size;
+    unload_file(&input);
+
+    if (!written)
+    {
+        printf("Couldn't write file \"%s\"\n", job->output);
+        totals->failed++;
+        return;
+    }
+
+    totals->converted++;
+    if (!batch->cache)
+        totals->bytes_written += (size_t) sink->offset;
+}
+
+static void batch_worker(void* user)
+{
+    Batch_Run* run = (Batch_Run*) user;
+    Batch_Worker* self = run->workers + atomic_fetch_add_int(&run->next_worker, 1);
+
+    Arena arena = arena_make(0);
+    Parser parser = parser_make(NULL, 0, &arena);
+    Sink sink = run->batch->cache ? sink_make_memory() : sink_make_fd(-1);
+
+    int job;
+    while ((job = take_job(run, self)) >= 0)
+        convert_job(run->batch, run->batch->jobs + job, &parser, &sink, &self->totals);
+
+    sink_close(&sink);
+    parser_free(&parser);
+    arena_free(&arena);
+}
+
+static int larger_job_first(const void* a, const void* b)
+{
+    const Batch_Job* x = (const Batch_Job*) a;
+    const Batch_Job* y = (const Batch_Job*) b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+Batch_Summary batch_run(Batch* batch, int threads)
+{
+    double wall_start = wall_clock();
+    double cpu_start  = cpu_clock();
+
+    int job_count = da_size(batch->jobs);
+    qsort(batch->jobs, job_count, sizeof(Batch_Job), larger_job_first);
+
+    if (threads > job_count)
+        threads = job_count;
+    if (threads > BATCH_MAX_THREADS)
+        threads = BATCH_MAX_THREADS;
+    if (threads < 1)
+        threads = 1;
+
+    Batch_Worker workers[BATCH_MAX_THREADS] = { 0 };
+    int* dealt = (int*) malloc(sizeof(int) * (job_count + 1));
+
+    // Dealt like cards, worker w gets jobs w, w + threads, ...
+    int at = 0;
+    for (int w = 0; w < threads; w++)
+    {
+        workers[w].queue.jobs = dealt + at;
+        for (int j = w; j < job_count; j += threads)
+            dealt[at++] = j;
+
+        workers[w].queue.count = (int) (dealt + at - workers[w].queue.jobs);
+    }
+
+    Batch_Run run = { batch, workers, threads, 0 };
+    threads_run(threads, batch_worker, &run);
+
+    Batch_Summary summary = { 0 };
+    for (int w = 0; w < threads; w++)
+    {
+        summary.files         += workers[w].totals.files;
+        summary.converted     += workers[w].totals.converted;
+        summary.failed        += workers[w].totals.failed;
+        summary.cached        += workers[w].totals.cached;
+        summary.unchanged     += workers[w].totals.unchanged;
+        summary.bytes_read    += workers[w].totals.bytes_read;
+        summary.bytes_written += workers[w].totals.bytes_written;
+    }
+
+    free(dealt);
+
+    summary.failed      += batch->missing;
+    summary.wall_seconds = wall_clock() - wall_start;
+    summary.cpu_seconds  = cpu_clock() - cpu_start;
+    return summary;
+}
+
+/*
+    Pipeline
+    Readers load files, parsers parse them and render the fdx into memory
+    (or copy it out of the cache), writers write that out. The stages pass
+    items along through bounded queues. There's only a fixed number of
+    items and a reader has to wait for a free one, so when the writers fall
+    behind everything before them slows down too instead of piling up
+    files in memory.
+
+    Shutting down goes down the stages, the last reader to finish pushes a
+    NULL for every parser and the last parser one for every writer.
+*/
+
+typedef struct _Pipeline_Item
+{
+    Batch_Job* job;
+    File_View input;
+    Sink output;        // Memory sink, the buffer is kept between files
+} Pipeline_Item;
+
+typedef struct _Pipeline
+{
+    Batch* batch;
+
+    Queue free_items;
+    Queue parse_queue;
+    Queue write_queue;
+
+    int next_job;
+    int readers_left;
+    int parsers_left;
+    int parsers;        // How many actually started, that's how many NULLs they need
+    int writers;
+} Pipeline;
+
+typedef struct _Pipeline_Thread
+{
+    Pipeline* pipeline;
+    Batch_Summary totals;
+    Thread thread;
+} Pipeline_Thread;
+
+// A mapped file is only read in when it's touched, better here than in a parser
+static void touch_pages(File_View* view)
+{
+    if (!view->mapped)
+        return;
+
+    volatile char sum = 0;
+    for (size_t at = 0; at < view->size; at += 4096)
+        sum += view->data[at];
+}
+
+static void reader_finished(Pipeline* pipeline)
+{
+    if (atomic_fetch_add_int(&pipeline->readers_left, -1) == 1)
+    {
+        for (int i = 0; i < pipeline->parsers; i++)
+            queue_push_wait(&pipeline->parse_queue, NULL);
+    }
+}
+
+static void pipeline_reader(void* user)
+{
+    Pipeline_Thread* self = (Pipeline_Thread*) user;
+    Pipeline* pipeline = self->pipeline;
+    int job_count = da_size(pipeline->batch->jobs);
+
+    int job;
+    while ((job = atomic_fetch_add_int(&pipeline->next_job, 1)) < job_count)
+    {
+        Batch_Job* next = pipeline->batch->jobs + job;
+
+        if (job + PIPELINE_PREFETCH_AHEAD < job_count)
+            prefetch_file(next[PIPELINE_PREFETCH_AHEAD].input);
+
+        Pipeline_Item* item = (Pipeline_Item*) queue_pop_wait(&pipeline->free_items);
+        item->job = next;
+
+        self->totals.files++;
+        if (!load_file(next->input, &item->input))
+        {
+            printf("Couldn't read file \"%s\"\n", next->input);
+            self->totals.failed++;
+            queue_push_wait(&pipeline->free_items, item);
+            continue;
+        }
+
+        touch_pages(&item->input);
+        self->totals.bytes_read += item->input.size;
+        queue_push_wait(&pipeline->parse_queue, item);
+    }
+
+    reader_finished(pipeline);
+}
+
+static void pipeline_parser(void* user)
+{
+    Pipeline_Thread* self = (Pipeline_Thread*) user;
+    Pipeline* pipeline = self->pipeline;
+
+    Arena arena = arena_make(0);
+    Parser parser = parser_make(NULL, 0, &arena);
+
+    Pipeline_Item* item;
+    while ((item = (Pipeline_Item*) queue_pop_wait(&pipeline->parse_queue)))
+    {
+        self->totals.cached += render_job(pipeline->batch->cache, &item->input, &parser, &item->output);
+
+        unload_file(&item->input);
+        queue_push_wait(&pipeline->write_queue, item);
+    }
+
+    if (atomic_fetch_add_int(&pipeline->parsers_left, -1) == 1)
+    {
+        for (int i = 0; i < pipeline->writers; i++)
+            queue_push_wait(&pipeline->write_queue, NULL);
+    }
+
+    parser_free(&parser);
+    arena_free(&arena);
+}
+
+static void pipeline_writer(void* user)
+{
+    Pipeline_Thread* self = (Pipeline_Thread*) user;
+    Pipeline* pipeline = self->pipeline;
+
+    Sink sink = sink_make_fd(-1);
+
+    Pipeline_Item* item;
+    while ((item = (Pipeline_Item*) queue_pop_wait(&pipeline->write_queue)))
+    {
+        Batch_Job* job = item->job;
+        String_Builder* rendered = &item->output.buffer;
+
+        int written;
+        if (pipeline->batch->cache)
+        {
+            written = write_rendered(job, rendered, &self->totals);
+        }
+        else
+        {
+            written = sink_reopen_file(&sink, job->output);
+            if (written)
+            {
+                sink_write(&sink, rendered->data, rendered->length);
+                written = sink_close_file(&sink);
+            }
+        }
+
+        if (written)
+        {
+            self->totals.converted++;
+            if (!pipeline->batch->cache)
+                self->totals.bytes_written += rendered->length;
+        }
+        else
+        {
+            printf("Couldn't write file \"%s\"\n", job->output);
+            self->totals.failed++;
+        }
+
+        queue_push_wait(&pipeline->free_items, item);
+    }
+
+    sink_close(&sink);
+}
+
+// Starts count threads running proc, returns how many started
+static int start_stage(Pipeline_Thread* threads, int count, Thread_Proc proc)
+{
+    int started = 0;
+    while (started < count && thread_start(&threads[started].thread, proc, threads + started))
+        started++;
+
+    return started;
+}
+
+Batch_Summary batch_run_pipelined(Batch* batch, int parsers, int io_threads)
+{
+    int job_count = da_size(batch->jobs);
+    if (job_count == 0 || io_threads < 1)
+        return batch_run(batch, parsers);
+
+    double wall_start = wall_clock();
+    double cpu_start  = cpu_clock();
+
+    qsort(batch->jobs, job_count, sizeof(Batch_Job), larger_job_first);
+
+    // The calling thread is a parser too
+    if (parsers < 1)
+        parsers = 1;
+    if (parsers > BATCH_MAX_THREADS)
+        parsers = BATCH_MAX_THREADS;
+    if (io_threads > BATCH_MAX_THREADS)
+        io_threads = BATCH_MAX_THREADS;
+
+    int total = parsers + io_threads * 2;
+    int item_count = total * PIPELINE_ITEMS_PER_THREAD;
+
+    Pipeline pipeline = { 0 };
+    pipeline.batch = batch;
+
+    // Big enough for every item and the NULLs that end the stages
+    pipeline.free_items  = queue_make(item_count);
+    pipeline.parse_queue = queue_make(item_count + parsers);
+    pipeline.write_queue = queue_make(item_count + io_threads);
+
+    Pipeline_Item* items = (Pipeline_Item*) calloc(item_count, sizeof(Pipeline_Item));
+    hd_assert(items != NULL);
+    for (int i = 0; i < item_count; i++)
+    {
+        items[i].output = sink_make_memory();
+        queue_push(&pipeline.free_items, items + i);
+    }
+
+    Pipeline_Thread* threads = (Pipeline_Thread*) calloc(total, sizeof(Pipeline_Thread));
+    hd_assert(threads != NULL);
+    for (int i = 0; i < total; i++)
+        threads[i].pipeline = &pipeline;
+
+    Pipeline_Thread* parser_threads = threads;
+    Pipeline_Thread* writer_threads = threads + parsers;
+    Pipeline_Thread* reader_threads = threads + parsers + io_threads;
+
+    // Started back to front, every stage has to know how many threads the
+    // one after it has before it can finish
+    pipeline.parsers = 1 + start_stage(parser_threads + 1, parsers - 1, pipeline_parser);
+    pipeline.parsers_left = pipeline.parsers;
+
+    pipeline.writers = start_stage(writer_threads, io_threads, pipeline_writer);
+    pipeline.readers_left = io_threads;
+
+    for (int i = 0; i < PIPELINE_PREFETCH_AHEAD && i < job_count; i++)
+        prefetch_file(batch->jobs[i].input);
+
+    // With no writers nothing would hand the items back, don't read anything
+    int readers = 0;
+    if (pipeline.writers > 0)
+        readers = start_stage(reader_threads, io_threads, pipeline_reader);
+
+    // Readers that didn't start are done already, that closes the pipeline if none did
+    for (int i = readers; i < io_threads; i++)
+        reader_finished(&pipeline);
+
+    pipeline_parser(parser_threads);
+
+    for (int i = 1; i < pipeline.parsers; i++)
+        thread_join(&parser_threads[i].thread);
+    for (int i = 0; i < pipeline.writers; i++)
+        thread_join(&writer_threads[i].thread);
+    for (int i = 0; i < readers; i++)
+        thread_join(&reader_threads[i].thread);
+
+    Batch_Summary summary = { 0 };
+    for (int i = 0; i < total; i++)
+    {
+        summary.files         += threads[i].totals.files;
+        summary.converted     += threads[i].totals.converted;
+        summary.failed        += threads[i].totals.failed;
+        summary.cached        += threads[i].totals.cached;
+        summary.unchanged     += threads[i].totals.unchanged;
+        summary.bytes_read    += threads[i].totals.bytes_read;
+        summary.bytes_written += threads[i].totals.bytes_written;
+    }
+
+    for (int i = 0; i < item_count; i++)
+        sink_close(&items[i].output);
+
+    free(items);
+    free(threads);
+    queue_free(&pipeline.free_items);
+    queue_free(&pipeline.parse_queue);
+    queue_free(&pipeline.write_queue);
+
+    // Without both io stages nothing got converted, do it the plain way
+    if (readers == 0 || pipeline.writers == 0)
+        return batch_run(batch, parsers);
+
+    summary.failed      += batch->missing;
+    summary.wall_seconds = wall_clock() - wall_start;
+    summary.cpu_seconds  = cpu_clock() - cpu_start;
+    return summary;
+}
+
+void batch_print_summary(Batch_Summary* summary)
+{
+    double mb_read    = summary->bytes_read / (1024.0 * 1024.0);
+    double mb_written = summary->bytes_written / (1024.0 * 1024.0);
+
+    printf("%d files, %d converted, %d failed\n", summary->files, summary->converted, summary->failed);
+    if (summary->cached || summary->unchanged)
+        printf("%d from the cache, %d outputs unchanged\n", summary->cached, summary->unchanged);
+    printf("%.2f MB read, %.2f MB written\n", mb_read, mb_written);
+    printf("%.3f s wall, %.3f s cpu", summary->wall_seconds, summary->cpu_seconds);
+
+    if (summary->wall_seconds > 0)
+        printf(", %.1f MB/s", mb_read / summary->wall_seconds);
+
+    printf("\n");
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include "cache.h"
+#include "containers/darray.h"
+#include "containers/string.h"
+
+typedef struct _Batch_Job
+{
+    String input;
+    String output;      // Next to the input with an .fdx extension
+    size_t size;
+} Batch_Job;
+
+typedef struct _Batch_Summary
+{
+    int files;
+    int converted;
+    int failed;         // Files that didn't convert and paths that couldn't be read
+    int cached;         // Converted straight from the cache
+    int unchanged;      // Outputs left alone because they already had the right bytes
+    size_t bytes_read;
+    size_t bytes_written;
+    double wall_seconds;
+    double cpu_seconds;     // Of the whole process, all threads together
+} Batch_Summary;
+
+typedef struct _Batch
+{
+    DArray(Batch_Job) jobs;
+    int missing;    // Paths given that didn't exist or couldn't be read
+    Fdx_Cache* cache;   // Optional. With one, outputs are only written when they change.
+} Batch;
+
+Batch batch_make(void);
+void  batch_free(Batch* batch);
+
+// Files are added if they're .fountain files, directories are walked for
+// them. Both return 0 if path couldn't be read.
+int batch_add_path(Batch* batch, const char* path);
+int batch_add_manifest(Batch* batch, const char* filepath);    // A path per line, # starts a comment line
+
+// Converts every job on up to threads threads, largest files first. Files
+// that fail are reported as they happen and the rest carry on.
+Batch_Summary batch_run(Batch* batch, int threads);
+
+// Same as batch_run but split into stages, io_threads threads read files
+// ahead of the parsers and as many write the results out behind them. For
+// slow storage, the reading and writing happen while the parsers are busy.
+Batch_Summary batch_run_pipelined(Batch* batch, int parsers, int io_threads);
+void batch_print_summary(Batch_Summary* summary);
\ No newline at end of file
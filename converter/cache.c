@@ -0,0 +1,50 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include "fdx.h"
+#include "containers/hash.h"
+
+int cache_open(Fdx_Cache* cache, const char* dir)
+{
+    cache->dir = NULL;
+    if (!make_directory(dir))
+        return 0;
+
+    cache->dir = string_make((char*) dir);
+    return 1;
+}
+
+void cache_close(Fdx_Cache* cache)
+{
+    if (cache->dir)
+        string_free(&cache->dir);
+}
+
+uint64_t cache_key(const char* data, size_t size)
+{
+    return hash_bytes(data, size, FDX_OUTPUT_VERSION);
+}
+
+static int entry_path(Fdx_Cache* cache, uint64_t key, char* path, size_t path_size)
+{
+    int n = snprintf(path, path_size, "%s/%016llx.fdx", cache->dir, (unsigned long long) key);
+    return n > 0 && n < (int) path_size;
+}
+
+int cache_load(Fdx_Cache* cache, uint64_t key, File_View* fdx)
+{
+    char path[4096];
+    if (!entry_path(cache, key, path, sizeof(path)))
+        return 0;
+
+    return load_file(path, fdx);
+}
+
+int cache_store(Fdx_Cache* cache, uint64_t key, const char* data, size_t size)
+{
+    char path[4096];
+    if (!entry_path(cache, key, path, sizeof(path)))
+        return 0;
+
+    return write_file_atomic(path, data, size);
+}
\ No newline at end of file
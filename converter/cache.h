@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "filestuff.h"
+#include "containers/string.h"
+
+// Conversions kept on disk, one .fdx per distinct input. Entries are named
+// after a hash of the input bytes seeded with FDX_OUTPUT_VERSION, so a hit
+// costs hashing the input and a new converter never sees an old one's output.
+// Safe to share between threads and processes, entries are written atomically.
+typedef struct _Fdx_Cache
+{
+    String dir;
+} Fdx_Cache;
+
+int  cache_open(Fdx_Cache* cache, const char* dir);     // Makes dir if it isn't there, 0 if it can't
+void cache_close(Fdx_Cache* cache);
+
+uint64_t cache_key(const char* data, size_t size);
+
+int cache_load(Fdx_Cache* cache, uint64_t key, File_View* fdx);     // 0 if it isn't cached
+int cache_store(Fdx_Cache* cache, uint64_t key, const char* data, size_t size);
\ No newline at end of file
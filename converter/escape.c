@@ -0,0 +1,76 @@
+#include "escape.h"
+
+#include <string.h>
+
+// How much longer every char gets when it's escaped, 0 for the ones that
+// stay as they are. Scanning only looks at this, a char per load.
+static const unsigned char escape_extra[256] = {
+    ['\"'] = 5,
+    ['\''] = 5,
+    ['<']  = 3,
+    ['>']  = 3,
+    ['&']  = 4,
+};
+
+static const char* const escapes[256] = {
+    ['\"'] = "&quot;",
+    ['\''] = "&apos;",
+    ['<']  = "&lt;",
+    ['>']  = "&gt;",
+    ['&']  = "&amp;",
+};
+
+int xml_escape_free(const char* src, int n)
+{
+    const unsigned char* s = (const unsigned char*) src;
+    int k = 0;
+
+    // Most text has nothing to escape, four at a time keeps the loads going
+    for (; k + 4 <= n; k += 4)
+    {
+        if (escape_extra[s[k]] | escape_extra[s[k + 1]] | escape_extra[s[k + 2]] | escape_extra[s[k + 3]])
+            break;
+    }
+
+    while (k < n && !escape_extra[s[k]])
+        k++;
+
+    return k;
+}
+
+int xml_escaped_length(const char* src, int n)
+{
+    const unsigned char* s = (const unsigned char*) src;
+    int len = n;
+
+    for (int k = 0; k < n; k++)
+        len += escape_extra[s[k]];
+
+    return len;
+}
+
+int xml_escape(char* dest, const char* src, int n)
+{
+    int len = 0;
+
+    while (n > 0)
+    {
+        // Runs between escapes are copied whole
+        int run = xml_escape_free(src, n);
+        memcpy(dest + len, src, run);
+        len += run;
+
+        if (run == n)
+            break;
+
+        unsigned char ch = (unsigned char) src[run];
+        int size = 1 + escape_extra[ch];
+        memcpy(dest + len, escapes[ch], size);
+        len += size;
+
+        src += run + 1;
+        n   -= run + 1;
+    }
+
+    return len;
+}
\ No newline at end of file
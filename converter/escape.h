@@ -0,0 +1,11 @@
+#pragma once
+
+// Chars at the start of src that don't need escaping, n if none of them do
+int xml_escape_free(const char* src, int n);
+
+// Exact length n chars of src come out as once escaped
+int xml_escaped_length(const char* src, int n);
+
+// Escapes n chars of src into dest, which needs xml_escaped_length room,
+// and returns how many were written
+int xml_escape(char* dest, const char* src, int n);
\ No newline at end of file
@@ -1,285 +1,637 @@
 #include "fdx.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "fountain.h"
 #include "filestuff.h"
 #include "format.h"
+#include "sink.h"
+#include "escape.h"
+#include "threads.h"
+#include "stats.h"
+#include "containers/hd_assert.h"
 
-static const char* get_elem_fmt_type(Elem e)
-{
-    switch (e.type)
-    {
-        case ELEM_SCENE_HEADING: return "Scene Heading";
-        case ELEM_ACTION:        return "Action";
-        case ELEM_CHARACTER:     return "Character";
-        case ELEM_DIALOGUE:      return "Dialogue";
-        case ELEM_PARENTHETICAL: return "Parenthetical";
-        case ELEM_TRANSITION:    return "Transition";
-        case ELEM_CENTERED_TEXT: return "General";
-
-        // Ignored
-        default: return "General";
-    }
-}
+// Elements below this are rendered on the calling thread
+#ifndef FDX_PARALLEL_MIN_ELEMENTS
+#define FDX_PARALLEL_MIN_ELEMENTS 4096
+#endif
+
+#define sink_write_tag(sink, tag) sink_write(sink, (tag).str, (tag).length)
+
+// The char arrays from format.h, their length is known without a strlen
+#define sink_write_literal(sink, str) sink_write(sink, str, sizeof(str) - 1)
 
-static const char* get_elem_fmt_alignment(Elem e)
+// Text without anything to escape is written as is, the rest is escaped
+// straight into the sink's buffer
+static void append_escaped(Sink* sink, const char* src, int n)
 {
-    switch (e.type)
+    int clean = xml_escape_free(src, n);
+    sink_write(sink, src, clean);
+
+    if (clean < n)
     {
-        case ELEM_SCENE_HEADING: return "Left";
-        case ELEM_ACTION:        return "Left";
-        case ELEM_CHARACTER:     return "Left";
-        case ELEM_DIALOGUE:      return "Left";
-        case ELEM_PARENTHETICAL: return "Left";
-        case ELEM_TRANSITION:    return "Right";
-        case ELEM_CENTERED_TEXT: return "Center";
-
-        // Ignored
-        default: return "Left";
+        src += clean;
+        n   -= clean;
+        xml_escape(sink_reserve(sink, xml_escaped_length(src, n)), src, n);
     }
 }
 
-void append_escaped(String* string, String other)
+static int count_lines(Elem* elem)
 {
-    int last_idx = 0;
-    for (int i = 0; i < other[i]; i++)
+    int count = 0;
+
+    for (int t = 0; t < elem->text_count; t++)
     {
-        switch (other[i])
+        Text* text = elem->texts + t;
+        for (int i = 0; i < text->span_count; i++)
         {
-            #define ESCAPE_CHAR(ch, escaped) \
-            case ch:\
-            {\
-                other[i] = '\0';\
-                string_append(string, other + last_idx);\
-                string_append(string, escaped);\
-                other[i] = ch;\
-                last_idx = i + 1;\
-            } break
-
-            ESCAPE_CHAR('\"', "&quot;");
-            ESCAPE_CHAR('\'', "&apos;");
-            ESCAPE_CHAR('<', "&lt;");
-            ESCAPE_CHAR('>', "&gt;");
-            ESCAPE_CHAR('&', "&amp;");
-
-            #undef ESCAPE_CHAR
+            if (text->spans[i].lead == '\n')
+                count++;
         }
     }
 
-    string_append(string, other + last_idx);
+    return count + 1;
 }
 
-static int count_lines(DArray(Text) texts)
+// skip_lead leaves out the lead of the first span
+static void append_text(Sink* sink, Parser* parser, Span* spans, int count, int emphasis_flags, int skip_lead)
 {
-    int count = 0;
+    sink_write_tag(sink, text_elem_starts[emphasis_flags]);
 
-    da_foreach(Text, text, texts)
+    for (int i = 0; i < count; i++)
     {
-        for(int i = 0; text->text[i]; i++)
-        {
-            if (text->text[i] == '\n')
-                count++;
-        }
+        if (spans[i].lead && !(skip_lead && i == 0))
+            append_escaped(sink, &spans[i].lead, 1);
+
+        append_escaped(sink, parser->content + spans[i].offset, spans[i].length);
     }
 
-    return count + 1;
+    sink_write_literal(sink, text_elem_end);
 }
 
-
-static void append_text(String* dest, String content, int emphasis_flags)
+// Exactly what append_text writes
+static size_t text_size(Parser* parser, Span* spans, int count, int emphasis_flags, int skip_lead)
 {
-    char buffer[64];
-    sprintf(buffer, text_elem_fmt_start, emphasis_styles[emphasis_flags]);
-    string_append(dest, buffer);
-    append_escaped(dest, content);
-    string_append(dest, text_elem_fmt_end);
+    size_t size = text_elem_starts[emphasis_flags].length + sizeof(text_elem_end) - 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (spans[i].lead && !(skip_lead && i == 0))
+            size += xml_escaped_length(&spans[i].lead, 1);
+
+        size += xml_escaped_length(parser->content + spans[i].offset, spans[i].length);
+    }
+
+    return size;
 }
 
-static void append_lines(String* dest, DArray(Text) texts, String alignment)
+static void append_lines(Sink* sink, Parser* parser, Elem* elem, Tag start)
 {
-    char buffer[128];
-
-    sprintf(buffer, title_page_elem_fmt_start, alignment);
-    string_append(dest, buffer);
+    sink_write_tag(sink, start);
     
-    da_foreach(Text, text, texts)
+    for (int t = 0; t < elem->text_count; t++)
     {
-        String content = text->text;
+        Text* text  = elem->texts + t;
+        Span* spans = text->spans;
 
-        int last_idx = 0;
-        for (int i = 0; content[i]; i++)
+        // Every '\n' lead starts a new paragraph
+        int first = 0, skip_lead = 0;
+        for (int i = 0; i < text->span_count; i++)
         {
-            if (content[i] == '\n')
+            if (spans[i].lead == '\n')
             {
-                int prev_line_was_ws = content[i - 1] == '\r';
-                content[i - prev_line_was_ws] = '\0';
+                append_text(sink, parser, spans + first, i - first, text->emphasis_flags, skip_lead);
+                sink_write_literal(sink, title_page_elem_end);
+                sink_write_tag(sink, start);
 
-                append_text(dest, content + last_idx, text->emphasis_flags);
-                string_append(dest, title_page_elem_fmt_end);
-                string_append(dest, buffer);
-
-                last_idx = i + 1;
-
-                if (prev_line_was_ws)
-                    content[i - 1] = '\r';
-                else
-                    content[i] = '\n';
+                first = i;
+                skip_lead = 1;
             }
         }
 
-        append_text(dest, content + last_idx, text->emphasis_flags);
+        append_text(sink, parser, spans + first, text->span_count - first, text->emphasis_flags, skip_lead);
     }
 
-    string_append(dest, title_page_elem_fmt_end);
+    sink_write_literal(sink, title_page_elem_end);
 }
 
-void generate_fdx(Parser* parser, String filepath)
+// Exactly what append_lines writes
+static size_t lines_size(Parser* parser, Elem* elem, Tag start)
 {
-    String screenplay_content = NULL;
-    da_foreach(Elem, elem, parser->elements)
+    size_t paragraph = start.length + sizeof(title_page_elem_end) - 1;
+    size_t size = paragraph;
+
+    for (int t = 0; t < elem->text_count; t++)
     {
-        // Handle page breaks properly later
-        if (elem->type == ELEM_BONEYARD)
-            continue;
+        Text* text  = elem->texts + t;
+        Span* spans = text->spans;
 
-        if (elem->type == ELEM_PAGE_BREAK)
+        int first = 0, skip_lead = 0;
+        for (int i = 0; i < text->span_count; i++)
         {
-            string_append(&screenplay_content, page_break_elem);
-            continue;
-        }
-
-        char buffer[128];
-        sprintf(buffer, elem_fmt_start, get_elem_fmt_type(*elem), get_elem_fmt_alignment(*elem));
-
-        string_append(&screenplay_content, buffer);
+            if (spans[i].lead == '\n')
+            {
+                size += text_size(parser, spans + first, i - first, text->emphasis_flags, skip_lead) + paragraph;
 
-        da_foreach(Text, text, elem->texts)
-            append_text(&screenplay_content, text->text, text->emphasis_flags);
+                first = i;
+                skip_lead = 1;
+            }
+        }
 
-        string_append(&screenplay_content, elem_fmt_end);
+        size += text_size(parser, spans + first, text->span_count - first, text->emphasis_flags, skip_lead);
     }
 
-    if (!screenplay_content)
-        screenplay_content = string_make("");
-
-    #define FILL_SMARTTYPE_SECTION(str, prop, prop_name, section_name) \
-    if (da_size(parser->prop) == 0)                     \
-        str = string_make(default_##prop);              \
-    else                                                \
-    {                                                   \
-        str= string_make("    <"section_name">\n");     \
-        da_foreach(String, s, parser->prop)             \
-        {                                               \
-            string_append(&str, "      <"prop_name">"); \
-            append_escaped(&str, *s);                   \
-            string_append(&str, "</"prop_name">\n");    \
-        }                                               \
-        string_append(&str, "    </"section_name">\n"); \
+    return size;
+}
+
+static void write_smarttype_section(Sink* sink, Parser* parser, DArray(int) list, const char* default_section,
+                                    SmartType_Tags* tags)
+{
+    if (da_size(list) == 0)
+    {
+        sink_write_str(sink, default_section);
+        return;
     }
 
-    String smarttype_characters = NULL;
-    FILL_SMARTTYPE_SECTION(smarttype_characters, characters, "Character", "Characters");
+    sink_write_tag(sink, tags->start);
+    da_foreach(int, id, list)
+    {
+        SmartType_String* s = parser->smarttype + *id;
 
-    // @Todo: Implement extensions later
-    String smarttype_extensions = string_make(default_extensions);
+        sink_write_tag(sink, tags->item_start);
+        sink_write(sink, s->escaped, s->escaped_length);
+        sink_write_tag(sink, tags->item_end);
+    }
+    sink_write_tag(sink, tags->end);
+}
 
-    String smarttype_scene_intros = NULL;
-    FILL_SMARTTYPE_SECTION(smarttype_scene_intros, scene_intros, "SceneIntro", "SceneIntros");
+// Exactly what write_smarttype_section writes
+static size_t smarttype_section_size(Parser* parser, DArray(int) list, const char* default_section,
+                                     SmartType_Tags* tags)
+{
+    if (da_size(list) == 0)
+        return strlen(default_section);
 
-    String smarttype_locations = NULL;
-    FILL_SMARTTYPE_SECTION(smarttype_locations, locations, "Location", "Locations");
+    size_t item = tags->item_start.length + tags->item_end.length;
+    size_t size = tags->start.length + tags->end.length + da_size(list) * item;
 
-    String smarttype_times_of_day = NULL;
-    FILL_SMARTTYPE_SECTION(smarttype_times_of_day, times_of_day, "TimeOfDay", "TimesOfDay");
+    da_foreach(int, id, list)
+        size += parser->smarttype[*id].escaped_length;
 
-    String smarttype_transitions = NULL;
-    FILL_SMARTTYPE_SECTION(smarttype_transitions, transitions, "Transition", "Transitions");
+    return size;
+}
 
-    #undef FILL_SMARTTYPE_SECTION
+#define TITLE_PAGE_LINES 60     // Painstakingly counted
 
-    String title_page_content = NULL;
-    const int total_lines = 60;     // Painstakingly counted
+typedef struct _Title_Part
+{
+    Elem* elem;
+    Tag start;
+    int line;       // The part's first line on the page, -1 if there's no such part
+} Title_Part;
+
+// Title, credit, author and contact, in that order. Lines the parts don't
+// take are empty paragraphs.
+static void title_page_layout(Parser* parser, Title_Part parts[4])
+{
+    Title_Part* title   = parts + 0;
+    Title_Part* credit  = parts + 1;
+    Title_Part* author  = parts + 2;
+    Title_Part* contact = parts + 3;
 
-    int title_start_idx   = -1;
-    int credit_start_idx  = -1;
-    int author_start_idx  = -1;
-    int contact_start_idx = -1;
+    for (int p = 0; p < 4; p++)
+    {
+        parts[p].line  = -1;
+        parts[p].start = title_page_center_start;
+    }
+    contact->start = title_page_left_start;
 
     int last_line = -1;
 
     // Determine a few things beforehand to make a proper title page layout
-    Dict_Bkt(Elem) title_bkt = dict_find(parser->title_page_details, "Title");
-    if (title_bkt != dict_end(parser->title_page_details))
+    title->elem = map_find_str(parser->title_page_details, "Title");
+    if (title->elem)
     {
-        int lines = count_lines(title_bkt->value.texts);
-        title_start_idx = (total_lines / 3) - (lines / 2);
-        last_line = title_start_idx + lines;
+        int lines = count_lines(title->elem);
+        title->line = (TITLE_PAGE_LINES / 3) - (lines / 2);
+        last_line = title->line + lines;
     }
 
-    Dict_Bkt(Elem) credit_bkt = dict_find(parser->title_page_details, "Credit");
-    if (credit_bkt != dict_end(parser->title_page_details))
+    credit->elem = map_find_str(parser->title_page_details, "Credit");
+    if (credit->elem)
     {
-        credit_start_idx = (last_line > 0) ? (last_line + 2) : ((total_lines / 3) + 2);
-        last_line = credit_start_idx + count_lines(credit_bkt->value.texts);
+        credit->line = (last_line > 0) ? (last_line + 2) : ((TITLE_PAGE_LINES / 3) + 2);
+        last_line = credit->line + count_lines(credit->elem);
     }
 
-    Dict_Bkt(Elem) author_bkt = dict_find(parser->title_page_details, "Author");
-    if (author_bkt == dict_end(parser->title_page_details))
-        author_bkt = dict_find(parser->title_page_details, "Authors");
+    author->elem = map_find_str(parser->title_page_details, "Author");
+    if (!author->elem)
+        author->elem = map_find_str(parser->title_page_details, "Authors");
 
-    if (author_bkt != dict_end(parser->title_page_details))
+    if (author->elem)
     {
-        author_start_idx = (last_line > 0) ? (last_line + 2) : (total_lines / 3) + 2;
-        last_line = author_start_idx + count_lines(author_bkt->value.texts);
+        author->line = (last_line > 0) ? (last_line + 2) : (TITLE_PAGE_LINES / 3) + 2;
+        last_line = author->line + count_lines(author->elem);
     }
 
-    Dict_Bkt(Elem) contact_bkt = dict_find(parser->title_page_details, "Contact");
-    if (contact_bkt != dict_end(parser->title_page_details))
-        contact_start_idx = total_lines - count_lines(contact_bkt->value.texts);
+    contact->elem = map_find_str(parser->title_page_details, "Contact");
+    if (contact->elem)
+        contact->line = TITLE_PAGE_LINES - count_lines(contact->elem);
+}
 
-    for (int i = 0; i < total_lines; i++)
+// Part that starts on line, NULL if it's an empty one
+static Title_Part* title_part_at(Title_Part parts[4], int line)
+{
+    for (int p = 0; p < 4; p++)
     {
-        if (i == title_start_idx)
-        {
-            append_lines(&title_page_content, title_bkt->value.texts, "Center");
-            i += count_lines(title_bkt->value.texts);
-            continue;
-        }
+        if (parts[p].line == line)
+            return parts + p;
+    }
+
+    return NULL;
+}
+
+static void write_title_page(Sink* sink, Parser* parser)
+{
+    Title_Part parts[4];
+    title_page_layout(parser, parts);
 
-        if (i == credit_start_idx)
+    for (int i = 0; i < TITLE_PAGE_LINES; i++)
+    {
+        Title_Part* part = title_part_at(parts, i);
+        if (part)
         {
-            append_lines(&title_page_content, credit_bkt->value.texts, "Center");
-            i += count_lines(credit_bkt->value.texts);
+            append_lines(sink, parser, part->elem, part->start);
+            i += count_lines(part->elem);
             continue;
         }
 
-        if (i == author_start_idx)
+        sink_write_literal(sink, title_page_empty_elem);
+    }
+}
+
+// Exactly what write_title_page writes
+static size_t title_page_size(Parser* parser)
+{
+    Title_Part parts[4];
+    title_page_layout(parser, parts);
+
+    size_t size = 0;
+    for (int i = 0; i < TITLE_PAGE_LINES; i++)
+    {
+        Title_Part* part = title_part_at(parts, i);
+        if (part)
         {
-            append_lines(&title_page_content, author_bkt->value.texts, "Center");
-            i += count_lines(author_bkt->value.texts);
+            size += lines_size(parser, part->elem, part->start);
+            i += count_lines(part->elem);
             continue;
         }
 
-        if (i == contact_start_idx)
+        size += sizeof(title_page_empty_elem) - 1;
+    }
+
+    return size;
+}
+
+static void write_elem(Sink* sink, Parser* parser, Elem* elem)
+{
+    stats_count(elements[elem->type], 1);
+
+    // Handle page breaks properly later
+    if (elem->type == ELEM_BONEYARD)
+        return;
+
+    if (elem->type == ELEM_PAGE_BREAK)
+    {
+        sink_write_literal(sink, page_break_elem);
+        return;
+    }
+
+    sink_write_tag(sink, elem_starts[elem->type]);
+
+    int toggles = 0;
+    int flags = EMPHASIS_NONE;
+    for (int t = 0; t < elem->text_count; t++)
+    {
+        Text* text = elem->texts + t;
+        append_text(sink, parser, text->spans, text->span_count, text->emphasis_flags, 0);
+
+        toggles += (text->emphasis_flags != flags);
+        flags = text->emphasis_flags;
+    }
+
+    sink_write_literal(sink, elem_end);
+
+    stats_count(text_runs, elem->text_count);
+    stats_count(emphasis_toggles, toggles);
+}
+
+// Exactly what write_elem writes
+static size_t elem_size(Parser* parser, Elem* elem)
+{
+    if (elem->type == ELEM_BONEYARD)
+        return 0;
+
+    if (elem->type == ELEM_PAGE_BREAK)
+        return sizeof(page_break_elem) - 1;
+
+    size_t size = elem_starts[elem->type].length + sizeof(elem_end) - 1;
+
+    for (int t = 0; t < elem->text_count; t++)
+    {
+        Text* text = elem->texts + t;
+        size += text_size(parser, text->spans, text->span_count, text->emphasis_flags, 0);
+    }
+
+    return size;
+}
+
+// Everything after the elements
+static void write_fdx_end(Parser* parser, Sink* sink)
+{
+    stats_start(timer);
+    sink_write_literal(sink, file_element_settings);
+
+    stats_start(title_page_timer);
+    write_title_page(sink, parser);
+    stats_stop(title_page_timer, STATS_FDX_TITLE_PAGE);
+
+    sink_write_literal(sink, file_title_page_end);
+
+    stats_start(smarttype_timer);
+    write_smarttype_section(sink, parser, parser->characters, default_characters, &characters_tags);
+
+    // @Todo: Implement extensions later
+    sink_write_literal(sink, default_extensions);
+
+    write_smarttype_section(sink, parser, parser->scene_intros, default_scene_intros, &scene_intros_tags);
+    write_smarttype_section(sink, parser, parser->locations, default_locations, &locations_tags);
+    write_smarttype_section(sink, parser, parser->times_of_day, default_times_of_day, &times_of_day_tags);
+    stats_stop(smarttype_timer, STATS_FDX_SMARTTYPE);
+
+    // @Todo: Transitions are collected but have never been written out, file_fmt
+    //        only had room for the five sections above. Add them with a format change.
+
+    sink_write_literal(sink, file_end);
+    stats_stop(timer, STATS_FDX_END);
+}
+
+// Exactly what write_fdx_end writes
+static size_t fdx_end_size(Parser* parser)
+{
+    size_t size = sizeof(file_element_settings) - 1 + title_page_size(parser) + sizeof(file_title_page_end) - 1;
+
+    size += smarttype_section_size(parser, parser->characters, default_characters, &characters_tags);
+    size += sizeof(default_extensions) - 1;
+    size += smarttype_section_size(parser, parser->scene_intros, default_scene_intros, &scene_intros_tags);
+    size += smarttype_section_size(parser, parser->locations, default_locations, &locations_tags);
+    size += smarttype_section_size(parser, parser->times_of_day, default_times_of_day, &times_of_day_tags);
+
+    return size + sizeof(file_end) - 1;
+}
+
+size_t fdx_size(Parser* parser)
+{
+    stats_start(timer);
+    size_t size = sizeof(file_start) - 1 + fdx_end_size(parser);
+
+    da_foreach(Elem, elem, parser->elements)
+        size += elem_size(parser, elem);
+
+    stats_stop(timer, STATS_FDX_SIZE);
+    return size;
+}
+
+// Writes the whole document in order, every part goes out as soon as it's made
+void write_fdx(Parser* parser, Sink* sink)
+{
+    sink_write_literal(sink, file_start);
+
+    stats_start(timer);
+    da_foreach(Elem, elem, parser->elements)
+        write_elem(sink, parser, elem);
+    stats_stop(timer, STATS_FDX_ELEMENTS);
+
+    write_fdx_end(parser, sink);
+}
+
+size_t render_fdx(Parser* parser, Sink* sink)
+{
+    hd_assert(sink->type == SINK_MEMORY);
+
+    size_t size = fdx_size(parser);
+    sb_reserve(&sink->buffer, size);
+
+    size_t before = sink->buffer.length;
+    write_fdx(parser, sink);
+
+    hd_assert(sink->buffer.length - before == size);
+    return size;
+}
+
+static void write_visited_elem(void* user, Parser* parser, Elem* elem)
+{
+    write_elem((Sink*) user, parser, elem);
+}
+
+// The elements are written as they're parsed, everything after them needs
+// the whole screenplay and only comes once it's parsed
+void stream_fdx(Parser* parser, Sink* sink)
+{
+    Parse_Visitor visitor = { sink, write_visited_elem, NULL, NULL };
+
+    sink_write_literal(sink, file_start);
+    parser_parse_visit(parser, &visitor);
+    write_fdx_end(parser, sink);
+}
+
+void stream_fdx_input(Parser* parser, Parse_Read read, void* user, Sink* sink)
+{
+    Parse_Visitor visitor = { sink, write_visited_elem, NULL, NULL };
+
+    sink_write_literal(sink, file_start);
+    parser_parse_stream(parser, read, user, &visitor);
+    write_fdx_end(parser, sink);
+}
+
+int generate_fdx_streamed(Parser* parser, String filepath)
+{
+    Sink sink;
+    if (!sink_open_file(&sink, filepath))
+        return 0;
+
+    stream_fdx(parser, &sink);
+
+    int ok = sink_close(&sink);
+    stats_add(bytes_out, sink.offset);
+    return ok;
+}
+
+int generate_fdx(Parser* parser, String filepath)
+{
+    Sink sink;
+    if (!sink_open_file(&sink, filepath))
+        return 0;
+
+    write_fdx(parser, &sink);
+
+    int ok = sink_close(&sink);
+    stats_add(bytes_out, sink.offset);
+    return ok;
+}
+
+int generate_fdx_mapped(Parser* parser, String filepath, Output_Sync sync)
+{
+    size_t size = fdx_size(parser);
+
+    Mapped_Output output;
+    if (!map_output_file(filepath, size, &output))
+        return 0;
+
+    Sink sink = sink_make_fixed(output.data, size);
+    write_fdx(parser, &sink);
+
+    // Coming out short would leave zeros at the end
+    int ok = sink_close(&sink) && sink.offset == (long long) size;
+    stats_add(bytes_out, sink.offset);
+
+    stats_start(timer);
+    ok = unmap_output_file(&output, sync) && ok;
+    stats_stop(timer, STATS_WRITE);
+    return ok;
+}
+
+int generate_fdx_gathered(Parser* parser, String filepath)
+{
+    Sink sink;
+    if (!sink_open_file_gather(&sink, filepath))
+        return 0;
+
+    write_fdx(parser, &sink);
+
+    int ok = sink_close(&sink);
+    stats_add(bytes_out, sink.offset);
+    return ok;
+}
+
+/*
+    Parallel generation
+    The elements are cut into ranges and every range is rendered on its own.
+    Sizing an element is much cheaper than rendering it, so a first pass
+    adds up the exact size of every range, which gives every range its
+    offset in the file. The second pass renders the ranges into per-thread
+    buffers that are written straight to their offsets, no range waits on
+    the ones before it.
+*/
+
+typedef struct _Render_Range
+{
+    int first;
+    int count;
+    size_t size;
+    long long offset;
+    int ok;
+} Render_Range;
+
+typedef struct _Render_Work
+{
+    Parser* parser;
+    Render_Range* ranges;
+    int count;
+    int next;       // Next range to be taken by a thread
+    int fd;
+    int measure;    // First pass, only sizes
+} Render_Work;
+
+static void render_worker(void* user)
+{
+    Render_Work* work = (Render_Work*) user;
+    Parser* parser = work->parser;
+
+    while (1)
+    {
+        int r = atomic_fetch_add_int(&work->next, 1);
+        if (r >= work->count)
+            break;
+
+        Render_Range* range = work->ranges + r;
+        Elem* elems = parser->elements + range->first;
+
+        if (work->measure)
         {
-            append_lines(&title_page_content, contact_bkt->value.texts, "Left");
-            i += count_lines(contact_bkt->value.texts);
+            range->size = 0;
+            for (int i = 0; i < range->count; i++)
+                range->size += elem_size(parser, elems + i);
+
             continue;
         }
 
-        string_append(&title_page_content, title_page_empty_elem);
+        Sink sink = sink_make_fd_at(work->fd, range->offset);
+        for (int i = 0; i < range->count; i++)
+            write_elem(&sink, parser, elems + i);
+
+        // Anything else would overwrite the next range or leave a hole
+        range->ok = sink_flush(&sink) && sink.offset == range->offset + (long long) range->size;
+        sink_close(&sink);
     }
+}
+
+int generate_fdx_parallel(Parser* parser, String filepath, int threads)
+{
+    int elem_count = da_size(parser->elements);
+    if (threads <= 1 || elem_count < FDX_PARALLEL_MIN_ELEMENTS)
+        return generate_fdx(parser, filepath);
+
+    Sink sink;
+    if (!sink_open_file(&sink, filepath))
+        return 0;
+
+    // A few ranges per thread so they even out
+    int count = threads * 4;
+    Render_Range* ranges = (Render_Range*) calloc(count, sizeof(Render_Range));
+    hd_assert(ranges != NULL);
+
+    for (int r = 0; r < count; r++)
+    {
+        ranges[r].first = (int) ((long long) elem_count * r / count);
+        ranges[r].count = (int) ((long long) elem_count * (r + 1) / count) - ranges[r].first;
+    }
+
+    Render_Work work = { parser, ranges, count, 0, sink.fd, 1 };
+
+    stats_start(size_timer);
+    threads_run(threads, render_worker, &work);
+    stats_stop(size_timer, STATS_FDX_SIZE);
+
+    long long offset = sizeof(file_start) - 1;
+    for (int r = 0; r < count; r++)
+    {
+        ranges[r].offset = offset;
+        offset += ranges[r].size;
+    }
+
+    // The start and end are small, they go out from here
+    sink_write_literal(&sink, file_start);
+    int ok = sink_flush(&sink);
+
+    Sink end = sink_make_fd_at(sink.fd, offset);
+    write_fdx_end(parser, &end);
+    ok = sink_close(&end) && ok;
+    stats_add(bytes_out, end.offset);
+
+    // The threads write the elements themselves, that's timed along with them
+    work.next = 0;
+    work.measure = 0;
+
+    stats_start(elem_timer);
+    threads_run(threads, render_worker, &work);
+    stats_stop(elem_timer, STATS_FDX_ELEMENTS);
+
+    for (int r = 0; r < count; r++)
+        ok = ranges[r].ok && ok;
 
-    FILE* file = fopen(filepath, "wb");
-    fprintf(file, file_fmt,
-            screenplay_content,
-            title_page_content,
-            smarttype_characters,
-            smarttype_extensions,
-            smarttype_scene_intros,
-            smarttype_locations,
-            smarttype_times_of_day,
-            smarttype_transitions);
-    fclose(file);
+    free(ranges);
+    return sink_close(&sink) && ok;
 }
\ No newline at end of file
@@ -1,5 +1,42 @@
 #pragma once
 
 #include "fountain.h"
+#include "filestuff.h"
+#include "sink.h"
 
-void generate_fdx(Parser* parser, String filepath);
\ No newline at end of file
+// Bump whenever write_fdx's output changes, cached conversions are keyed on it
+#define FDX_OUTPUT_VERSION 2
+
+void write_fdx(Parser* parser, Sink* sink);
+
+// Exactly how many bytes write_fdx writes for parser, without writing them.
+// Sizing is a lot cheaper than writing, it only counts what escaping adds.
+size_t fdx_size(Parser* parser);
+
+// write_fdx into a memory sink, its buffer grows to the exact size once up
+// front instead of doubling as it goes. Returns the size.
+size_t render_fdx(Parser* parser, Sink* sink);
+int  generate_fdx(Parser* parser, String filepath);     // Returns 0 if the file couldn't be written
+
+// Same file as generate_fdx. The file is made at its exact size up front,
+// mapped and rendered into in place, sync says what happens before it's unmapped.
+int  generate_fdx_mapped(Parser* parser, String filepath, Output_Sync sync);
+
+// Same file as generate_fdx. Text and the fixed parts of the file aren't
+// copied into a buffer first, they're written where they are with writev.
+// For file systems where writing through a mapping is slow.
+int  generate_fdx_gathered(Parser* parser, String filepath);
+
+// Parses parser and writes the output in one go, parser_parse_visit with the
+// generator as the visitor. Same output as parsing and then write_fdx, but
+// the elements are never all in memory at once.
+void stream_fdx(Parser* parser, Sink* sink);
+int  generate_fdx_streamed(Parser* parser, String filepath);
+
+// stream_fdx with the input read as it goes, for pipes. Neither the input
+// nor the elements are ever all in memory.
+void stream_fdx_input(Parser* parser, Parse_Read read, void* user, Sink* sink);
+
+// Same file as generate_fdx, the elements are rendered on up to threads threads
+// and written in place. Small screenplays are written serially.
+int  generate_fdx_parallel(Parser* parser, String filepath, int threads);
\ No newline at end of file
@@ -1,38 +1,520 @@
 #include "filestuff.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "threads.h"
 #include "containers/string.h"
 
-String load_file(const String filepath)
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define READ_CHUNK_SIZE (64 * 1024)
+
+#ifdef _WIN32
+
+static int map_file(const char* filepath, File_View* view)
+{
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+
+    if (!mapping)
+        return 0;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);   // The view keeps the mapping alive
+
+    if (!data)
+        return 0;
+
+    view->data   = (char*) data;
+    view->size   = (size_t) size.QuadPart;
+    view->mapped = 1;
+    return 1;
+}
+
+static int read_whole_file(const char* filepath, File_View* view)
 {
     FILE* file = fopen(filepath, "rb");
     if (!file)
-        return NULL;
+        return 0;
+
+    size_t cap = READ_CHUNK_SIZE, len = 0;
+    char* data = (char*) malloc(cap);
+
+    while (data)
+    {
+        if (len == cap)
+        {
+            cap *= 2;
+            char* grown = (char*) realloc(data, cap);
+            if (!grown)
+            {
+                free(data);
+                data = NULL;
+                break;
+            }
 
-    fseek(file, 0, SEEK_END);
-    size_t len = ftell(file);
-    fseek(file, 0, SEEK_SET);
+            data = grown;
+        }
 
-    String contents = NULL;
-    string_resize(&contents, len);
-    
-    fread(contents, sizeof(char), len, file);
-    contents[len] = '\0';
+        size_t read = fread(data + len, sizeof(char), cap - len, file);
+        if (read == 0)
+            break;
 
+        len += read;
+    }
+
+    int failed = ferror(file) || !data;
     fclose(file);
 
-    return contents;
+    if (failed)
+    {
+        free(data);
+        return 0;
+    }
+
+    view->data   = data;
+    view->size   = len;
+    view->mapped = 0;
+    return 1;
+}
+
+int load_file(const char* filepath, File_View* view)
+{
+    *view = (File_View) { 0 };
+
+    if (map_file(filepath, view))
+        return 1;
+
+    return read_whole_file(filepath, view);
+}
+
+void unload_file(File_View* view)
+{
+    if (view->data)
+    {
+        if (view->mapped) UnmapViewOfFile(view->data);
+        else              free(view->data);
+    }
+
+    *view = (File_View) { 0 };
+}
+
+void prefetch_file(const char* filepath)
+{
+    // Mapping with FILE_FLAG_SEQUENTIAL_SCAN already reads ahead aggressively
+    (void) filepath;
+}
+
+int path_info(const char* path, int* is_directory, size_t* size)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+
+    *is_directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    *size = ((size_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    return 1;
+}
+
+int walk_directory(const char* dirpath, Walk_Callback callback, void* user)
+{
+    String pattern = string_make((char*) dirpath);
+    string_append(&pattern, "\\*");
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    string_free(&pattern);
+
+    if (find == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0)
+            continue;
+
+        String path = string_make((char*) dirpath);
+        string_append(&path, "\\");
+        string_append(&path, data.cFileName);
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                walk_directory(path, callback, user);
+        }
+        else
+        {
+            callback(user, path, ((size_t) data.nFileSizeHigh << 32) | data.nFileSizeLow);
+        }
+
+        string_free(&path);
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+    return 1;
+}
+
+int make_directory(const char* path)
+{
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+static int replace_file(const char* from, const char* to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static int process_id(void)
+{
+    return _getpid();
+}
+
+int map_output_file(const char* filepath, size_t size, Mapped_Output* output)
+{
+    *output = (Mapped_Output) { 0 };
+
+    HANDLE file = CreateFileA(filepath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    output->file = file;
+    output->size = size;
+    if (size == 0)
+        return 1;
+
+    // Mapping past the end of the file grows it to the mapping's size
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD) ((unsigned long long) size >> 32),
+                                        (DWORD) size, NULL);
+    if (mapping)
+    {
+        output->data = (char*) MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        CloseHandle(mapping);   // The view keeps the mapping alive
+    }
+
+    if (!output->data)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+
+    return 1;
+}
+
+int unmap_output_file(Mapped_Output* output, Output_Sync sync)
+{
+    int ok = 1;
+    if (output->data)
+    {
+        if (sync != OUTPUT_SYNC_NONE)
+            ok = FlushViewOfFile(output->data, 0) != 0;
+
+        ok = UnmapViewOfFile(output->data) && ok;
+    }
+
+    if (sync == OUTPUT_SYNC_WAIT)
+        ok = FlushFileBuffers((HANDLE) output->file) && ok;
+
+    ok = CloseHandle((HANDLE) output->file) && ok;
+    *output = (Mapped_Output) { 0 };
+    return ok;
+}
+
+#else
+
+// Fallback for inputs that can't be mapped, reads till EOF in chunks
+static int read_whole_fd(int fd, size_t size_hint, File_View* view)
+{
+    size_t cap = (size_hint > 0) ? size_hint + 1 : READ_CHUNK_SIZE, len = 0;
+    char* data = (char*) malloc(cap);
+    if (!data)
+        return 0;
+
+    while (1)
+    {
+        if (len == cap)
+        {
+            cap *= 2;
+            char* grown = (char*) realloc(data, cap);
+            if (!grown)
+            {
+                free(data);
+                return 0;
+            }
+
+            data = grown;
+        }
+
+        ssize_t bytes = read(fd, data + len, cap - len);
+        if (bytes == 0)
+            break;
+
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            free(data);
+            return 0;
+        }
+
+        len += (size_t) bytes;
+    }
+
+    view->data   = data;
+    view->size   = len;
+    view->mapped = 0;
+    return 1;
+}
+
+int load_file(const char* filepath, File_View* view)
+{
+    *view = (File_View) { 0 };
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (S_ISREG(st.st_mode))
+    {
+        // Nothing to map, an empty file is still a valid input
+        if (st.st_size == 0)
+        {
+            close(fd);
+            return 1;
+        }
+
+        void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+
+            view->data   = (char*) data;
+            view->size   = (size_t) st.st_size;
+            view->mapped = 1;
+            return 1;
+        }
+    }
+
+    int success = read_whole_fd(fd, S_ISREG(st.st_mode) ? (size_t) st.st_size : 0, view);
+    close(fd);
+    return success;
+}
+
+void unload_file(File_View* view)
+{
+    if (view->data)
+    {
+        if (view->mapped) munmap(view->data, view->size);
+        else              free(view->data);
+    }
+
+    *view = (File_View) { 0 };
+}
+
+void prefetch_file(const char* filepath)
+{
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    // The page cache keeps what's read in after the fd is closed
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+int path_info(const char* path, int* is_directory, size_t* size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    *is_directory = S_ISDIR(st.st_mode);
+    *size = (size_t) st.st_size;
+    return 1;
+}
+
+int walk_directory(const char* dirpath, Walk_Callback callback, void* user)
+{
+    DIR* dir = opendir(dirpath);
+    if (!dir)
+        return 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        String path = string_make((char*) dirpath);
+        string_append(&path, "/");
+        string_append(&path, entry->d_name);
+
+        // lstat so links to directories can't send us around in circles
+        struct stat st;
+        if (lstat(path, &st) == 0)
+        {
+            if (S_ISDIR(st.st_mode))
+                walk_directory(path, callback, user);
+            else if (S_ISREG(st.st_mode))
+                callback(user, path, (size_t) st.st_size);
+            else if (S_ISLNK(st.st_mode) && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+                callback(user, path, (size_t) st.st_size);
+        }
+
+        string_free(&path);
+    }
+
+    closedir(dir);
+    return 1;
 }
 
+int make_directory(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static int replace_file(const char* from, const char* to)
+{
+    return rename(from, to) == 0;
+}
+
+static int process_id(void)
+{
+    return (int) getpid();
+}
+
+int map_output_file(const char* filepath, size_t size, Mapped_Output* output)
+{
+    *output = (Mapped_Output) { 0 };
+
+    int fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 0;
+
+    output->fd   = fd;
+    output->size = size;
+    if (size == 0)
+        return 1;
+
+    // Not every file system can allocate ahead, those only get the size
+    int error = posix_fallocate(fd, 0, (off_t) size);
+    int sized = (error == 0) || ((error == EOPNOTSUPP || error == EINVAL) && ftruncate(fd, (off_t) size) == 0);
+
+    void* data = sized ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+
+    output->data = (char*) data;
+    return 1;
+}
+
+int unmap_output_file(Mapped_Output* output, Output_Sync sync)
+{
+    int ok = 1;
+    if (output->data)
+    {
+        if (sync != OUTPUT_SYNC_NONE)
+            ok = msync(output->data, output->size, (sync == OUTPUT_SYNC_WAIT) ? MS_SYNC : MS_ASYNC) == 0;
+
+        ok = (munmap(output->data, output->size) == 0) && ok;
+    }
+
+    if (sync == OUTPUT_SYNC_WAIT)
+        ok = (fsync(output->fd) == 0) && ok;
+
+    ok = (close(output->fd) == 0) && ok;
+    *output = (Mapped_Output) { 0 };
+    return ok;
+}
+
+#endif // _WIN32
+
+// Up to the NUL, what string_length gives depends on how the String was made
 int write_file(const String filepath, String contents)
+{
+    return write_file_bytes(filepath, contents, strlen(contents));
+}
+
+int write_file_bytes(const char* filepath, const char* data, size_t size)
 {
     FILE* file = fopen(filepath, "wb");
     if (!file)
         return 0;
 
-    fputs(contents, file);
+    int ok = fwrite(data, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+int write_file_atomic(const char* filepath, const char* data, size_t size)
+{
+    // Unique between threads and processes writing the same file
+    static int counter = 0;
+    char temp[4096];
+    int n = snprintf(temp, sizeof(temp), "%s.%d-%d.tmp", filepath, process_id(), atomic_fetch_add_int(&counter, 1));
+    if (n < 0 || n >= (int) sizeof(temp))
+        return 0;
+
+    if (!write_file_bytes(temp, data, size) || !replace_file(temp, filepath))
+    {
+        remove(temp);
+        return 0;
+    }
 
-    fclose(file);
     return 1;
+}
+
+int write_file_if_changed(const char* filepath, const char* data, size_t size, int* changed)
+{
+    File_View old;
+    if (load_file(filepath, &old))
+    {
+        int same = (old.size == size) && (size == 0 || memcmp(old.data, data, size) == 0);
+        unload_file(&old);
+
+        if (same)
+        {
+            *changed = 0;
+            return 1;
+        }
+    }
+
+    *changed = 1;
+    return write_file_bytes(filepath, data, size);
 }
\ No newline at end of file
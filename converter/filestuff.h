@@ -1,6 +1,69 @@
 #pragma once
 
+#include <stddef.h>
 #include "containers/string.h"
 
-String load_file(const String filepath);
-int write_file(const String filepath, String contents);
\ No newline at end of file
+// Read-only view of a whole file. Regular files are memory mapped and
+// parsed in place, anything that can't be mapped (pipes, character
+// devices) is read into a heap buffer instead. The data is *not* NUL
+// terminated, always use size.
+typedef struct _File_View
+{
+    char*  data;
+    size_t size;
+    int    mapped;
+} File_View;
+
+int  load_file(const char* filepath, File_View* view);
+void unload_file(File_View* view);
+
+// Asks the OS to start reading the file in the background so a load_file
+// later on doesn't have to wait for it. Only a hint, does nothing on Windows.
+void prefetch_file(const char* filepath);
+
+// What's written into a mapped file has to be on disk by the time it's unmapped
+typedef enum _Output_Sync
+{
+    OUTPUT_SYNC_NONE,   // Left to the OS, the pages go out whenever it gets to them
+    OUTPUT_SYNC_ASYNC,  // Writing them out is started but not waited for
+    OUTPUT_SYNC_WAIT,   // They're all on disk
+} Output_Sync;
+
+// A file made at a size known up front and mapped so it can be written in
+// place. data is NULL for an empty file.
+typedef struct _Mapped_Output
+{
+    char*  data;
+    size_t size;
+#ifdef _WIN32
+    void* file;
+#else
+    int fd;
+#endif
+} Mapped_Output;
+
+// The space is allocated right away where the file system can, so running
+// out of it fails here instead of while the mapping is written.
+int map_output_file(const char* filepath, size_t size, Mapped_Output* output);
+int unmap_output_file(Mapped_Output* output, Output_Sync sync);
+
+int write_file(const String filepath, String contents);
+int write_file_bytes(const char* filepath, const char* data, size_t size);
+
+// Writes a temporary file next to filepath and renames it over, anything
+// reading filepath sees either the old file or the whole new one
+int write_file_atomic(const char* filepath, const char* data, size_t size);
+
+// Leaves the file alone if it already holds exactly data, so its mtime stays
+// put. changed is set to whether it had to be written.
+int write_file_if_changed(const char* filepath, const char* data, size_t size, int* changed);
+
+int make_directory(const char* path);   // 1 if it's there afterwards
+
+// 0 if there's nothing at path, size is only set for files
+int path_info(const char* path, int* is_directory, size_t* size);
+
+// Calls callback for every file under dirpath, going into subdirectories but
+// not following links to them. Returns 0 if dirpath couldn't be opened.
+typedef void (*Walk_Callback)(void* user, const char* filepath, size_t size);
+int walk_directory(const char* dirpath, Walk_Callback callback, void* user);
\ No newline at end of file
@@ -1,36 +1,60 @@
 #pragma once
 
-char* emphasis_styles[] = {
-    "",
-    "Italic",
-    "Bold",
-    "Bold+Italic",
-    "Underline",
-    "Italic+Underline",
-    "Bold+Underline",
-    "Bold+Italic+Underline",
+// A piece of output that's always the same, written out whole beforehand
+// so it's only ever copied
+typedef struct _Tag
+{
+    const char* str;
+    int length;
+} Tag;
+
+#define TAG(str) { str, sizeof(str) - 1 }
+
+// Opening <Text> for every emphasis_flags
+#define TEXT_START(style) TAG("      <Text Style=\"" style "\">")
+
+Tag text_elem_starts[] = {
+    TEXT_START(""),
+    TEXT_START("Italic"),
+    TEXT_START("Bold"),
+    TEXT_START("Bold+Italic"),
+    TEXT_START("Underline"),
+    TEXT_START("Italic+Underline"),
+    TEXT_START("Bold+Underline"),
+    TEXT_START("Bold+Italic+Underline"),
 };
 
-char page_break_elem[] =
-"    <Paragraph Type=\"Action\" StartsNewPage=\"Yes\">\n"
-"    <Text />\n"
-"    </Paragraph>\n";
+char text_elem_end[] = "</Text>\n";
 
-char text_elem_fmt_start[] =
-"      <Text Style=\"%s\">";
+// Opening <Paragraph> for every Elem_Type, in its order. Boneyards aren't
+// written and page breaks are page_break_elem.
+#define ELEM_START(type, alignment) TAG("    <Paragraph Type=\"" type "\" Alignment=\"" alignment "\">\n")
 
-char text_elem_fmt_end[] = "</Text>\n";
+Tag elem_starts[] = {
+    ELEM_START("General", "Left"),          // ELEM_TP_DETAIL
+    ELEM_START("Scene Heading", "Left"),    // ELEM_SCENE_HEADING
+    ELEM_START("Action", "Left"),           // ELEM_ACTION
+    ELEM_START("Character", "Left"),        // ELEM_CHARACTER
+    ELEM_START("Dialogue", "Left"),         // ELEM_DIALOGUE
+    ELEM_START("Parenthetical", "Left"),    // ELEM_PARENTHETICAL
+    ELEM_START("Transition", "Right"),      // ELEM_TRANSITION
+    ELEM_START("General", "Center"),        // ELEM_CENTERED_TEXT
+    ELEM_START("General", "Left"),          // ELEM_BONEYARD
+    ELEM_START("General", "Left"),          // ELEM_PAGE_BREAK
+};
 
-char elem_fmt_start[] =
-"    <Paragraph Type=\"%s\" Alignment=\"%s\">\n";
+char elem_end[] =
+"    </Paragraph>\n";
 
-char elem_fmt_end[] =
+char page_break_elem[] =
+"    <Paragraph Type=\"Action\" StartsNewPage=\"Yes\">\n"
+"    <Text />\n"
 "    </Paragraph>\n";
 
-char title_page_elem_fmt_start[] =
-"      <Paragraph Alignment=\"%s\">\n";
+Tag title_page_center_start = TAG("      <Paragraph Alignment=\"Center\">\n");
+Tag title_page_left_start   = TAG("      <Paragraph Alignment=\"Left\">\n");
 
-char title_page_elem_fmt_end[] =
+char title_page_elem_end[] =
 "      </Paragraph>\n";
 
 char title_page_empty_elem[] =
@@ -38,6 +62,23 @@ char title_page_empty_elem[] =
 "        <Text />\n"
 "      </Paragraph>\n";
 
+// The tags around a SmartType list and every string in it
+typedef struct _SmartType_Tags
+{
+    Tag start;
+    Tag end;
+    Tag item_start;
+    Tag item_end;
+} SmartType_Tags;
+
+#define SMARTTYPE_TAGS(section, item) { \
+    TAG("    <" section ">\n"), TAG("    </" section ">\n"), TAG("      <" item ">"), TAG("</" item ">\n") }
+
+SmartType_Tags characters_tags   = SMARTTYPE_TAGS("Characters", "Character");
+SmartType_Tags scene_intros_tags = SMARTTYPE_TAGS("SceneIntros", "SceneIntro");
+SmartType_Tags locations_tags    = SMARTTYPE_TAGS("Locations", "Location");
+SmartType_Tags times_of_day_tags = SMARTTYPE_TAGS("TimesOfDay", "TimeOfDay");
+
 char default_characters[] =
 "    <Characters />\n";
 
@@ -94,11 +135,16 @@ char default_transitions[] =
 "      <Transition>TIME CUT:</Transition>\n"
 "    </Transitions>\n";
 
-char file_fmt[] =
+// The file is written out in these chunks with the generated sections in between
+char file_start[] =
 "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n"
 "<FinalDraft DocumentType=\"Script\" Template=\"No\" Version=\"4\">\n"
 "\n"
-"  <Content>\n%s"
+"  <Content>\n";
+
+// Content goes here
+
+char file_element_settings[] =
 "  </Content>\n"
 "\n"
 "  <ElementSettings Type=\"General\">\n"
@@ -168,13 +214,22 @@ char file_fmt[] =
 "  </ElementSettings>\n"
 "\n"
 "  <TitlePage>\n"
-"    <Content>\n%s"
+"    <Content>\n";
+
+// Title page goes here
+
+char file_title_page_end[] =
 "    </Content>\n"
 "  </TitlePage>\n"
 "\n"
 "  <UnanchoredScriptNotes/>\n"
 "\n"
-"  <SmartType>\n%s%s%s%s%s</SmartType>\n"
+"  <SmartType>\n";
+
+// SmartType sections go here
+
+char file_end[] =
+"</SmartType>\n"
 "\n"
 "  <MoresAndContinueds>\n"
 "    <FontSpec AdornmentStyle=\"0\" Background=\"#FFFFFFFFFFFF\" Color=\"#000000000000\" Font=\"Courier Final Draft\" RevisionID=\"0\" Size=\"12\" Style=\"\"/>\n"
@@ -1,100 +1,66 @@
 #include "fountain.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include "scanner.h"
+#include "escape.h"
+#include "threads.h"
+#include "stats.h"
+
 #define STRING_IMPL
 #include "containers/string.h"
 
 #define DARRAY_IMPL
 #include "containers/darray.h"
 
-#define DICTIONARY_IMPL
-#include "containers/dictionary.h"
+#define ARENA_IMPL
+#include "containers/arena.h"
+
+#define HASH_IMPL
+#include "containers/hash.h"
+
+#define HASH_MAP_IMPL
+#include "containers/hash_map.h"
+
+#define INTERN_IMPL
+#include "containers/intern.h"
 
+// Page breaks and boneyards don't have any text
 Elem elem_make(Elem_Type type)
 {
-    Elem e = { type, 0 };
-
-    if (type != ELEM_PAGE_BREAK && type != ELEM_BONEYARD)
-        da_make(e.texts);
-    
+    Elem e = { type, NULL, 0, 0, 0 };
     return e;
 }
 
-void elem_process(Elem* elem, String line, int* emphasis_flags)
+Parser parser_make(char* content, size_t length, Arena* arena)
 {
-    int start_idx = 0;
-    for (int i = 0; line[i]; i++)
-    {
-        if (line[i] == '_')
-        {
-            if (i > start_idx && line[i - 1] != '*' && line[i - 1] != '_')
-            {
-                Text t = { *emphasis_flags, NULL };
-            
-                line[i] = '\0';
-                t.text = string_make(line + start_idx);
-                line[i] = '_';
-
-                da_push_back(elem->texts, t);
-            }
-
-            start_idx = i + 1;
-            *emphasis_flags ^= EMPHASIS_UNDERLINED;
-            continue;
-        }
-
-        if (line[i] == '*')
-        {
-            if (i > start_idx && line[i - 1] != '*' && line[i - 1] != '_')
-            {
-                Text t = { *emphasis_flags, NULL };
-            
-                line[i] = '\0';
-                t.text = string_make(line + start_idx);
-                line[i] = '*';
-
-                da_push_back(elem->texts, t);
-            }
-
-            if (line[i + 1] == '*')
-            {
-                start_idx = i + 2;
-                *emphasis_flags ^= EMPHASIS_BOLD;
-                i++;
-            }
-            else
-            {
-                start_idx = i + 1;
-                *emphasis_flags ^= EMPHASIS_ITALICIZED;
-            }
+    Parser p = { 0 };
+    p.content = content;
+    p.length  = (int) length;
 
-            continue;
-        }
+    if (arena)
+    {
+        p.arena = arena;
     }
-
-    
-    // Add the remaining text
-    Text t = { *emphasis_flags, NULL };
-    t.text = string_make(line + start_idx);
-    da_push_back(elem->texts, t);
-}
-
-void elem_free(Elem* elem)
-{
-    da_foreach(Text, t, elem->texts)
+    else
     {
-        if (t->text)
-            string_free(&t->text);
+        p.arena = (Arena*) malloc(sizeof(Arena));
+        hd_assert(p.arena != NULL);
+        *p.arena = arena_make(0);
+        p.owns_arena = 1;
     }
 
-    da_free(elem->texts);
-}
-
-Parser parser_make(String content)
-{
-    Parser p = { 0 };
-    p.content = content;
-    dict_make(p.title_page_details);
+    map_make(p.title_page_details);
     da_make(p.elements);
+    da_make(p.lines);
+    da_make(p.marks);
+    da_make(p.pieces);
+    da_make(p.spans);
+    da_make(p.texts);
+    da_make(p.chars);
+
+    p.interned = intern_make(p.arena);
+    da_make(p.smarttype);
 
     da_make(p.characters);
     da_make(p.scene_intros);
@@ -102,48 +68,96 @@ Parser parser_make(String content)
     da_make(p.times_of_day);
     da_make(p.transitions);
 
+    da_make(p.checkpoints);
+    da_make(p.smarttype_refs);
+
+    da_make(p.old_lines);
+    da_make(p.old_marks);
+    da_make(p.old_elements);
+    da_make(p.old_checkpoints);
+
     return p;
 }
 
-static void free_string_array(DArray(String)* arr)
+void parser_reset(Parser* parser, char* content, size_t length)
 {
-    da_foreach(String, str, (*arr))
-    {
-        if (*str)
-            string_free(str);
-    }
-
-    da_free((*arr));
+    map_clear(parser->title_page_details);
+
+    da_clear(parser->elements);
+    da_clear(parser->lines);
+    da_clear(parser->marks);
+
+    intern_clear(&parser->interned);
+    da_clear(parser->smarttype);
+
+    da_clear(parser->characters);
+    da_clear(parser->scene_intros);
+    da_clear(parser->locations);
+    da_clear(parser->times_of_day);
+    da_clear(parser->transitions);
+
+    da_clear(parser->checkpoints);
+    da_clear(parser->smarttype_refs);
+    parser->smarttype_counted = 0;
+    parser->smarttype_lost = 0;
+
+    arena_reset(parser->arena);
+
+    parser->content = content;
+    parser->length  = (int) length;
+    parser->idx  = 0;
+    parser->line = 0;
+    parser->mark = 0;
+
+    parser->prev_line_empty = 0;
+    parser->next_line_empty = 0;
+    parser->line_all_caps   = 0;
+    parser->emphasis_flags  = 0;
 }
 
+// Everything the elements point to is in the arena so nothing has to be walked
 void parser_free(Parser* parser)
 {
-    if (parser->content)
-        string_free(&parser->content);
+    map_free(parser->title_page_details);
 
-    dict_foreach(String, it, parser->title_page_details)
-    {
-        if (it->key)
-        {
-            string_free(&it->key);
+    da_free(parser->elements);
+    da_free(parser->lines);
+    da_free(parser->marks);
+    da_free(parser->pieces);
+    da_free(parser->spans);
+    da_free(parser->texts);
+    da_free(parser->chars);
 
-            if (it->value)
-                string_free(&it->value);
-        }
-    }
+    intern_free(&parser->interned);
+    da_free(parser->smarttype);
 
-    dict_free(parser->title_page_details);
+    da_free(parser->characters);
+    da_free(parser->scene_intros);
+    da_free(parser->locations);
+    da_free(parser->times_of_day);
+    da_free(parser->transitions);
 
-    da_foreach(Elem, elem, parser->elements)
-        elem_free(elem);
+    da_free(parser->checkpoints);
+    da_free(parser->smarttype_refs);
 
-    da_free(parser->elements);
+    da_free(parser->old_lines);
+    da_free(parser->old_marks);
+    da_free(parser->old_elements);
+    da_free(parser->old_checkpoints);
+
+    free(parser->stream_buffer);
+
+    if (parser->owns_arena)
+    {
+        arena_free(parser->arena);
+        free(parser->arena);
+    }
+    else
+    {
+        arena_reset(parser->arena);
+    }
 
-    free_string_array(&parser->characters);
-    free_string_array(&parser->scene_intros);
-    free_string_array(&parser->locations);
-    free_string_array(&parser->times_of_day);
-    free_string_array(&parser->transitions);
+    parser->arena = NULL;
 }
 
 static int is_ws(char ch)
@@ -161,7 +175,7 @@ static int is_alphabet(char ch)
 
 static char peek(Parser* parser, int offset)
 {
-    if (parser->idx + offset >= string_length(parser->content) + 1)
+    if (parser->idx + offset >= parser->length)
         return 0;
 
     return parser->content[parser->idx + offset];
@@ -169,7 +183,7 @@ static char peek(Parser* parser, int offset)
 
 static char consume(Parser* parser)
 {
-    if (parser->idx >= string_length(parser->content) + 1)
+    if (parser->idx >= parser->length)
         return 0;
 
     return parser->content[parser->idx++];
@@ -177,10 +191,10 @@ static char consume(Parser* parser)
 
 static void consume_n(Parser* parser, int n)
 {
-    if (parser->idx + n >= string_length(parser->content))
-        parser->idx = string_length(parser->content);
-
-    parser->idx += n;
+    if (parser->idx + n >= parser->length)
+        parser->idx = parser->length;
+    else
+        parser->idx += n;
 }
 
 static void consume_ws(Parser* parser)
@@ -189,225 +203,503 @@ static void consume_ws(Parser* parser)
         consume(parser);
 }
 
-static void consume_line(Parser* parser)
+static void finish_line(Parser* parser, Line_Info* info)
 {
-    while (peek(parser, 0))
+    if (info->first < 0)
     {
-        char ch = consume(parser);
-        if (ch == '\n')
-            break;
+        info->first  = info->length;
+        info->flags |= LINE_EMPTY;
     }
+
+    if (info->last_lower < 0)
+        info->flags |= LINE_ALL_CAPS;
+
+    char* line = parser->content + info->start;
+    if ((info->length >= 1 && line[0] == '\t') ||
+        (info->length >= 3 && line[0] == ' ' && line[1] == ' ' && line[2] == ' '))
+        info->flags |= LINE_INDENTED;
+
+    da_push_back(parser->lines, *info);
 }
 
-static int line_is_empty(Parser* parser)
+// Runs the SIMD scanner over [start, end) of the content and adds its lines
+// and structural char marks from the masks. Lines are split on the newline
+// bits and the rest of a line's info comes from the highest/lowest bits in
+// its range. start has to be the start of a line and end the end of the
+// content or right after a '\n', the line after the last '\n' is only
+// added if finish is set.
+static void index_range(Parser* parser, int start, int end, int finish)
 {
-    int i = 0;
-    char ch;
-    while (ch = peek(parser, i))
+    Line_Info info = { start, 0, -1, -1, -1, 0 };
+
+    for (int base = start; base < end; base += SCAN_BLOCK_SIZE)
     {
-        if (ch == '\n')
-            return 1;
+        int len = end - base;
+        if (len > SCAN_BLOCK_SIZE)
+            len = SCAN_BLOCK_SIZE;
 
-        if (ch != ' '  &&
-            ch != '\t' &&
-            ch != '\r')
-            return 0;
+        Scan_Masks masks;
+        scan_block(parser->content + base, len, &masks);
+
+        for (uint64_t bits = masks.structural; bits; bits &= bits - 1)
+            da_push_back(parser->marks, base + scan_first_bit(bits));
+
+        uint64_t newlines = masks.newline;
+        int from = 0;
+        while (1)
+        {
+            int to = newlines ? scan_first_bit(newlines) : SCAN_BLOCK_SIZE;
+            uint64_t range = scan_bits_from(from) & scan_bits_below(to);
 
-        i++;
+            uint64_t non_ws = masks.non_ws & range;
+            if (non_ws)
+            {
+                if (info.first < 0)
+                    info.first = base + scan_first_bit(non_ws) - info.start;
+
+                info.last = base + scan_last_bit(non_ws) - info.start;
+            }
+
+            uint64_t lower = masks.lower & range;
+            if (lower)
+                info.last_lower = base + scan_last_bit(lower) - info.start;
+
+            if (!newlines)
+                break;
+
+            info.length = base + to - info.start;
+            finish_line(parser, &info);
+
+            info = (Line_Info) { base + to + 1, 0, -1, -1, -1, 0 };
+            newlines &= newlines - 1;
+            from = to + 1;
+        }
     }
 
-    // No non-ws char encountered in final line
-    return 1;
+    // Whatever is after the last '\n' is a line too, even if it's empty
+    if (finish)
+    {
+        info.length = end - info.start;
+        finish_line(parser, &info);
+    }
 }
 
-static int line_is_indented(Parser* parser)
+static void build_line_index(Parser* parser)
 {
-    if (parser->idx == 0)
-        return peek(parser, 0) == '\t' ||
-               (peek(parser, 0) == ' '  &&
-                peek(parser, 1) == ' '  &&
-                peek(parser, 2) == ' ');
+    da_clear(parser->lines);
+    da_clear(parser->marks);
+
+    index_range(parser, 0, parser->length, 1);
+
+    parser->line = 0;
+    parser->mark = 0;
+}
+
+// Offset of the first structural char in [from, to), to if there are none.
+// Like current_line this keeps a cursor so forward scans are amortized O(1).
+static int next_mark(Parser* parser, int from, int to)
+{
+    int count = da_size(parser->marks);
+    int m = parser->mark;
 
-    int offset = 0;
-    while (offset < parser->idx)
+    if (m > 0 && parser->marks[m - 1] >= from)
     {
-        if (peek(parser, -offset) == '\n')
+        // Went backwards, find the first mark >= from again
+        int lo = 0, hi = m;
+        while (lo < hi)
         {
-            return peek(parser, 1 - offset) == '\t' ||
-                   (peek(parser, 1 - offset) == ' '  &&
-                    peek(parser, 2 - offset) == ' '  &&
-                    peek(parser, 3 - offset) == ' ');
+            int mid = lo + (hi - lo) / 2;
+            if (parser->marks[mid] < from) lo = mid + 1;
+            else                           hi = mid;
         }
 
-        offset++;
+        m = lo;
     }
 
-    return 0;
+    while (m < count && parser->marks[m] < from)
+        m++;
+
+    parser->mark = m;
+    return (m < count && parser->marks[m] < to) ? parser->marks[m] : to;
 }
 
-static int line_is_all_caps(Parser* parser)
+// Syncs parser->line with idx, idx mostly moves forward so this is amortized O(1)
+static Line_Info* current_line(Parser* parser)
 {
-    int offset = 0;
-    while (peek(parser, offset) && peek(parser, offset) != '\n')
-    {
-        if (peek(parser, offset) >= 'a' && peek(parser, offset) <= 'z')
-            return 0;
+    int count = da_size(parser->lines);
 
-        offset++;
+    while (parser->line + 1 < count && parser->lines[parser->line + 1].start <= parser->idx)
+        parser->line++;
+
+    while (parser->line > 0 && parser->lines[parser->line].start > parser->idx)
+        parser->line--;
+
+    return parser->lines + parser->line;
+}
+
+static Line_Info* next_line(Parser* parser)
+{
+    Line_Info* line = current_line(parser);
+
+    if (parser->line + 1 >= (int) da_size(parser->lines))
+        return NULL;
+
+    return line + 1;
+}
+
+// Offset right after the current line's '\n', or the end of the content
+static int line_end(Parser* parser, Line_Info* line)
+{
+    int end = line->start + line->length;
+    return (end < parser->length) ? end + 1 : end;
+}
+
+static void consume_line(Parser* parser)
+{
+    parser->idx = line_end(parser, current_line(parser));
+}
+
+// Checks if the rest of the line, starting at idx, is empty
+static int line_is_empty(Parser* parser)
+{
+    Line_Info* line = current_line(parser);
+    return parser->idx > line->start + line->last;
+}
+
+static int line_is_indented(Parser* parser)
+{
+    Line_Info* line = current_line(parser);
+
+    if (parser->idx == 0)
+        return (line->flags & LINE_INDENTED) != 0;
+
+    // Standing on a '\n' means the line after it is the one being checked
+    if (parser->idx == line->start + line->length && parser->idx < parser->length)
+    {
+        Line_Info* next = next_line(parser);
+        return next && (next->flags & LINE_INDENTED);
     }
 
-    return 1;
+    // The first line only counts as indented from its very start
+    if (line->start < 2)
+        return 0;
+
+    return (line->flags & LINE_INDENTED) != 0;
+}
+
+// Checks if the rest of the line, starting at idx, has no lowercase letters
+static int line_is_all_caps(Parser* parser)
+{
+    Line_Info* line = current_line(parser);
+    return parser->idx > line->start + line->last_lower;
 }
 
 static int next_line_is_empty(Parser* parser)
 {
-    int prev_idx = parser->idx;
-    consume_line(parser);
-    int is_empty = line_is_empty(parser);
-    parser->idx = prev_idx;
-    return is_empty;
+    Line_Info* next = next_line(parser);
+    return !next || (next->flags & LINE_EMPTY);
 }
 
-static String get_title_page_key(Parser* parser)
+// The key is left in the content, returns NULL if there isn't one
+static char* get_title_page_key(Parser* parser, int* length)
 {
-    int offset = 0;
-    while (peek(parser, offset) && peek(parser, offset) != '\n')
+    Line_Info* line = current_line(parser);
+    int end = line->start + line->length;
+
+    for (int at = next_mark(parser, parser->idx, end); at < end; at = next_mark(parser, at + 1, end))
     {
-        if (peek(parser, offset) == ':')
+        if (parser->content[at] == ':')
         {
             char* start = parser->content + parser->idx;
+            int offset = at - parser->idx;
             consume_n(parser, offset + 1);
-            return string_make_till_n(start, offset);
+            *length = offset;
+            return start;
         }
-
-        offset++;
     }
 
     return NULL;
 }
 
-static String get_line(Parser* parser)
+static void push_piece(Parser* parser, int from, int to, char lead)
 {
-    DArray(char) buffer = NULL;
-    da_make(buffer);
+    if (from == to && !lead)
+        return;
+
+    Span piece = { from, to - from, lead };
+    da_push_back(parser->pieces, piece);
+}
 
-    while (peek(parser, 0) && peek(parser, 0) != '\n')
+// Adds [from, to) to the pieces, split around the '\r's, and '\t's if asked to.
+// lead goes before the first piece, it gets an empty one if nothing is left.
+static void push_range(Parser* parser, int from, int to, char lead, int skip_tabs)
+{
+    int start = from;
+    for (int at = next_mark(parser, from, to); ; at = next_mark(parser, at + 1, to))
     {
-        if (peek(parser, 0) == '\r')
+        if (at < to)
         {
-            consume(parser);
-            continue;
+            char ch = parser->content[at];
+            if (ch != '\r' && !(skip_tabs && ch == '\t'))
+                continue;
         }
 
-        da_push_back(buffer, consume(parser));
+        if (at > start)
+        {
+            push_piece(parser, start, at, lead);
+            lead = 0;
+        }
+
+        if (at == to)
+            break;
+
+        start = at + 1;
     }
 
-    da_push_back(buffer, '\0');
-    consume(parser);
+    if (lead)
+        push_piece(parser, to, to, lead);
+}
+
+static void get_line(Parser* parser, char lead)
+{
+    Line_Info* line = current_line(parser);
+    push_range(parser, parser->idx, line->start + line->length, lead, 0);
+
+    parser->idx = line_end(parser, line);
+}
+
+// Joins lines till an empty one with a single space, leading whitespace
+// on the joined lines and tabs are dropped
+static void get_multiline(Parser* parser)
+{
+    Line_Info* line = current_line(parser);
+    Line_Info* lines_end = parser->lines + da_size(parser->lines);
+
+    Line_Info* last = line;
+    while (last + 1 < lines_end && !(last[1].flags & LINE_EMPTY))
+        last++;
+
+    push_range(parser, parser->idx, line->start + line->length, 0, 1);
+    for (Line_Info* l = line + 1; l <= last; l++)
+        push_range(parser, l->start + l->first, l->start + l->length, ' ', 1);
+
+    // Stop at the '\n' of the empty line
+    if (last + 1 < lines_end)
+        parser->idx = last[1].start + last[1].length;
+    else
+        parser->idx = parser->length;
+}
+
+// Stops at the end of the content if the delim doesn't exist ahead
+static void get_till_char(Parser* parser, char delim)
+{
+    char* start = parser->content + parser->idx;
+    char* end   = memchr(start, delim, parser->length - parser->idx);
+
+    if (!end)
+        end = parser->content + parser->length;
+
+    push_piece(parser, parser->idx, (int) (end - parser->content), 0);
+}
+
+// Char before the one at 'at' in pieces[p], as if the pieces were one string
+static char piece_prev_char(Parser* parser, Span* pieces, int p, int at)
+{
+    if (at > pieces[p].offset)
+        return parser->content[at - 1];
+
+    if (pieces[p].lead)
+        return pieces[p].lead;
+
+    if (p == 0)
+        return 0;
+
+    // Only pieces with a lead can be empty
+    Span* prev = pieces + p - 1;
+    return prev->length ? parser->content[prev->offset + prev->length - 1] : prev->lead;
+}
+
+// Char after the one at 'at' in pieces[p], as if the pieces were one string
+static char piece_next_char(Parser* parser, Span* pieces, int count, int p, int at)
+{
+    if (at + 1 < pieces[p].offset + pieces[p].length)
+        return parser->content[at + 1];
+
+    if (p + 1 == count)
+        return 0;
 
-    String line = string_make(buffer);
-    da_free(buffer);
-    return line;
+    Span* next = pieces + p + 1;
+    return next->lead ? next->lead : parser->content[next->offset];
 }
 
-static String get_multiline(Parser* parser)
+// Adds a Text for [from, to) of the joined pieces. piece and base point at the
+// first piece that isn't behind from, and its offset in the joined pieces.
+static void push_text(Parser* parser, Span* pieces, int count, int* piece, int* base, int from, int to)
 {
-    DArray(char) buffer = NULL;
-    da_make(buffer);
+    Text t = { parser->emphasis_flags, NULL, 0 };
 
-    int encountered_newline = 0;
-    int added_ws = 0;
-    char ch;
-    while (ch = peek(parser, 0))
+    for (; *piece < count && *base < to; (*piece)++)
     {
-        if (ch == '\r')
-        {
-            consume(parser);
-            continue;
-        }
+        Span* p = pieces + *piece;
+        int content_base = *base + (p->lead != 0);
+        int end = content_base + p->length;
 
-        if (ch == '\n')
+        if (end > from)
         {
-            if (encountered_newline)
-                break;
-                
-            consume(parser);
-            encountered_newline = 1;
-            added_ws = 0;
-            continue;
-        }
+            int lo = (from > content_base) ? from : content_base;
+            int hi = (to < end) ? to : end;
 
-        if (encountered_newline && ch == ' ' || ch == '\t')
-        {
-            consume(parser);
-            continue;
-        }
+            Span span = { p->offset + lo - content_base, (hi > lo) ? hi - lo : 0, 0 };
+            if (from <= *base)
+                span.lead = p->lead;
 
-        if (encountered_newline && !added_ws)
-        {
-            da_push_back(buffer, ' ');
-            added_ws = 1;
+            if (span.lead || span.length)
+            {
+                da_push_back(parser->spans, span);
+                t.span_count++;
+            }
         }
 
-        da_push_back(buffer, consume(parser));
-        encountered_newline = 0;
+        // The rest of the piece goes to the next text
+        if (end > to)
+            break;
+
+        *base = end;
     }
-    
-    da_push_back(buffer, '\0');
 
-    String line = string_make(buffer);
-    da_free(buffer);
-    return line;
+    da_push_back(parser->texts, t);
 }
 
-// This won't check if the delim exists ahead
-static String get_till_char(Parser* parser, char delim)
+// Splits the pieces into texts on the emphasis markers. Offsets here are as if
+// the pieces were joined into one string, and the texts only reference them.
+void elem_process(Parser* parser, Elem* elem, Span* pieces, int count)
 {
-    return string_make_till_char(parser->content + parser->idx, delim);
+    int start_idx = 0;
+    int skip_idx  = 0;      // A "**" was handled as one marker, skip its second '*'
+    int base = 0;
+
+    int text_piece = 0, text_base = 0;
+
+    da_clear(parser->spans);
+    da_clear(parser->texts);
+
+    // An empty one still gets where it is, the SmartType lists are ordered by it
+    if (count > 0)
+    {
+        elem->source_start = pieces[0].offset;
+        elem->source_end   = pieces[count - 1].offset + pieces[count - 1].length;
+    }
+    else
+    {
+        elem->source_start = elem->source_end = parser->idx;
+    }
+
+    for (int p = 0; p < count; p++)
+    {
+        int offset = pieces[p].offset;
+        int end    = offset + pieces[p].length;
+        int content_base = base + (pieces[p].lead != 0);
+
+        // Only '*' and '_' matter here so jump from one mark to the next
+        for (int at = next_mark(parser, offset, end); at < end; at = next_mark(parser, at + 1, end))
+        {
+            char ch = parser->content[at];
+            int i = content_base + at - offset;
+
+            if ((ch != '*' && ch != '_') || i < skip_idx)
+                continue;
+
+            if (i > start_idx)
+            {
+                char prev = piece_prev_char(parser, pieces, p, at);
+                if (prev != '*' && prev != '_')
+                    push_text(parser, pieces, count, &text_piece, &text_base, start_idx, i);
+            }
+
+            if (ch == '_')
+            {
+                start_idx = i + 1;
+                parser->emphasis_flags ^= EMPHASIS_UNDERLINED;
+            }
+            else if (piece_next_char(parser, pieces, count, p, at) == '*')
+            {
+                start_idx = skip_idx = i + 2;
+                parser->emphasis_flags ^= EMPHASIS_BOLD;
+            }
+            else
+            {
+                start_idx = i + 1;
+                parser->emphasis_flags ^= EMPHASIS_ITALICIZED;
+            }
+        }
+
+        base = content_base + pieces[p].length;
+    }
+
+    // Add the remaining text
+    push_text(parser, pieces, count, &text_piece, &text_base, start_idx, base);
+
+    // Move the texts and their spans into the arena in one go each
+    int text_count = da_size(parser->texts);
+    int span_count = da_size(parser->spans);
+
+    elem->texts      = arena_push_array(parser->arena, Text, text_count);
+    elem->text_count = text_count;
+    Span* spans      = arena_push_array(parser->arena, Span, span_count);
+
+    memcpy(spans, parser->spans, span_count * sizeof(Span));
+    for (int i = 0; i < text_count; i++)
+    {
+        elem->texts[i] = parser->texts[i];
+        elem->texts[i].spans = spans;
+        spans += elem->texts[i].span_count;
+    }
 }
 
 static void parse_title_page(Parser* parser)
 {
+    stats_start(timer);
     consume_ws(parser);
     
     while (!line_is_empty(parser))
     {
-        String key = get_title_page_key(parser);
+        int key_length;
+        char* key = get_title_page_key(parser, &key_length);
         // If no title page details are provided
         if (key == NULL)
             break;
 
-        String value = NULL;
+        da_clear(parser->pieces);
         if (line_is_empty(parser))
         {
             consume_line(parser);
             int first_line = 1;
             while (line_is_indented(parser) && !line_is_empty(parser))
             {
-                if (!first_line)
-                    string_append(&value, "\n");
-                else
-                    first_line = 0;
-
                 consume_ws(parser);
-                String line = get_line(parser);
+                get_line(parser, first_line ? 0 : '\n');
                 consume_line(parser);
 
-                string_append(&value, line);
-                string_free(&line);
+                first_line = 0;
             }
         }
         else
         {
             consume_ws(parser);
-            value = get_line(parser);
+            get_line(parser, 0);
             consume_line(parser);
         }
 
         Elem e = elem_make(ELEM_TP_DETAIL);
-        elem_process(&e, value, &parser->emphasis_flags);
-        dict_put(parser->title_page_details, key, e);
+        elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+        map_put(parser->title_page_details, key, key_length, e);
+
+        Parse_Visitor* visitor = parser->visitor;
+        if (visitor && visitor->on_title_page)
+            visitor->on_title_page(visitor->user, parser, key, key_length, &e);
     }
+
+    stats_stop(timer, STATS_TITLE_PAGE);
 }
 
 static int line_starts_with(Parser* parser, String substr)
@@ -424,45 +716,27 @@ static int line_starts_with(Parser* parser, String substr)
 
 static int line_ends_with(Parser* parser, String substr)
 {
-    int start_index = parser->idx;
+    Line_Info* line = current_line(parser);
     int len = strlen(substr);
 
-    consume_line(parser);
-
-    for (int index = 0; substr[index]; index++)
-    {
-        if (peek(parser, -(len - index + 1)) != substr[index])
-        {
-            parser->idx = start_index;
-            return 0;
-        }
-    }
+    // Compares against the chars right before the '\n'. The last line of the
+    // content has no '\n' so it's compared against the chars before its last char.
+    int end = line_end(parser, line) - 1;
+    if (end - len < 0)
+        return 0;
 
-    parser->idx = start_index;
-    return 1;
+    return memcmp(parser->content + end - len, substr, len) == 0;
 }
 
 static int line_wrapped_with(Parser* parser, char left, char right)
 {
-    if (peek(parser, 0) == left)
-    {
-        int prev_index = parser->idx;
-        consume_line(parser);
-        int offset = 1;
-        while (parser->idx - offset > prev_index)
-        {
-            char ch = peek(parser, -offset);
-            offset++;
+    if (peek(parser, 0) != left)
+        return 0;
 
-            if (is_ws(ch))
-                continue;
-            
-            parser->idx = prev_index;
-            return ch == right;
-        }
-    }
+    Line_Info* line = current_line(parser);
+    int last = line->start + line->last;
 
-    return 0;
+    return last > parser->idx && parser->content[last] == right;
 }
 
 // @Todo: This should also work for lowercase letters
@@ -520,17 +794,23 @@ static int is_character(Parser* parser)
     return found_char;
 }
 
-static int is_dialogue(Parser* parser)
+// Type of the element before the one being parsed, -1 if there isn't one
+static int prev_elem_type(Parser* parser)
 {
-    int last_elem_idx = da_size(parser->elements) - 1;
-    if (last_elem_idx < 0)
-        return 0;
+    int last = da_size(parser->elements) - 1;
+    if (last >= 0)
+        return parser->elements[last].type;
 
-    Elem_Type prev_elem_type = parser->elements[last_elem_idx].type;
+    return parser->visitor ? parser->visited_type : -1;
+}
+
+static int is_dialogue(Parser* parser)
+{
+    int prev_type = prev_elem_type(parser);
 
     // If previous element was a character or a parenthetical
-    if (prev_elem_type == ELEM_CHARACTER ||
-        prev_elem_type == ELEM_PARENTHETICAL)
+    if (prev_type == ELEM_CHARACTER ||
+        prev_type == ELEM_PARENTHETICAL)
         return 1;
 
     // @Todo: Look for { number spaces } for empty lines
@@ -540,16 +820,12 @@ static int is_dialogue(Parser* parser)
 
 static int is_parenthetical(Parser* parser)
 {
-    int last_elem_idx = da_size(parser->elements) - 1;
-    if (last_elem_idx < 0)
-        return 0;
-
-    Elem_Type prev_elem_type = parser->elements[last_elem_idx].type;
+    int prev_type = prev_elem_type(parser);
 
     // If previous element was a character or a parenthetical
-    if (prev_elem_type == ELEM_CHARACTER     ||
-        prev_elem_type == ELEM_PARENTHETICAL ||
-        prev_elem_type == ELEM_DIALOGUE)
+    if (prev_type == ELEM_CHARACTER     ||
+        prev_type == ELEM_PARENTHETICAL ||
+        prev_type == ELEM_DIALOGUE)
     {
         return line_wrapped_with(parser, '(', ')');
     }
@@ -579,19 +855,125 @@ static int is_centered_text(Parser* parser)
     return line_wrapped_with(parser, '>', '<');
 }
 
-static void push_unique_string_or_free(DArray(String)* list, String* str)
+/*
+    SmartType counting
+    parser_edit takes the SmartType strings of the elements it drops out of
+    the lists and adds the new ones, so it needs to know how many elements
+    are behind every string. A full parse adds strings in the order they're
+    first seen, so the lists are kept sorted by where that is. Dropping the
+    first one of a string leaves its first unknown till a new element has
+    it again, if none does the lists are counted again from scratch.
+*/
+
+static SmartType_Ref* smarttype_ref(Parser* parser, int id, SmartType_List flag)
 {
-    int size = da_size((*list));
-    for (int i = 0; i < size; i++)
+    SmartType_Ref none = { 0, 0 };
+    while (da_size(parser->smarttype_refs) < (size_t) (id + 1) * SMARTTYPE_LIST_COUNT)
+        da_push_back(parser->smarttype_refs, none);
+
+    return parser->smarttype_refs + id * SMARTTYPE_LIST_COUNT + scan_first_bit(flag);
+}
+
+static void list_remove(DArray(int)* list, int id)
+{
+    for (int at = 0; at < (int) da_size(*list); at++)
     {
-        if (string_cmp((*list)[i], *str))
+        if ((*list)[at] == id)
         {
-            string_free(str);
+            da_erase_at((*list), at);
             return;
         }
     }
+}
+
+// After the ones with the same first, a scene heading can add more than one
+static void list_insert_sorted(Parser* parser, DArray(int)* list, SmartType_List flag, int id, int first)
+{
+    int lo = 0, hi = da_size(*list);
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (smarttype_ref(parser, (*list)[mid], flag)->first <= first) lo = mid + 1;
+        else                                                          hi = mid;
+    }
+
+    da_insert((*list), lo, id);
+}
+
+static void count_smarttype(Parser* parser, DArray(int)* list, SmartType_List flag, int id)
+{
+    SmartType_Ref* ref = smarttype_ref(parser, id, flag);
+    SmartType_String* s = parser->smarttype + id;
+    int at = parser->smarttype_at;
+
+    if (parser->smarttype_delta < 0)
+    {
+        ref->count--;
+        if (ref->count == 0)
+        {
+            s->lists &= ~flag;
+            list_remove(list, id);
+
+            if (ref->first < 0)
+                parser->smarttype_lost--;
+        }
+        else if (ref->first == at)
+        {
+            list_remove(list, id);
+            ref->first = -1;
+            parser->smarttype_lost++;
+        }
+
+        return;
+    }
+
+    ref->count++;
+    if (ref->count == 1 || ref->first < 0 || at < ref->first)
+    {
+        if (ref->count == 1)
+            s->lists |= flag;
+        else if (ref->first < 0)
+            parser->smarttype_lost--;
+        else
+            list_remove(list, id);
+
+        ref->first = at;
+        list_insert_sorted(parser, list, flag, id, at);
+    }
+}
+
+// Adds the n chars of str to list unless they're already in it. New strings
+// are interned and escaped right away so the generator only copies bytes.
+static void push_smarttype(Parser* parser, DArray(int)* list, SmartType_List flag, char* str, int n)
+{
+    int is_new;
+    int id = intern(&parser->interned, str, n, &is_new);
+
+    if (is_new)
+    {
+        int length = xml_escaped_length(str, n);
+        char* escaped = arena_push_array(parser->arena, char, length);
+
+        SmartType_String s = { escaped, xml_escape(escaped, str, n), 0 };
+        da_push_back(parser->smarttype, s);
+    }
+
+    if (parser->smarttype_delta)
+    {
+        count_smarttype(parser, list, flag, id);
+        return;
+    }
 
-    da_push_back((*list), *str);
+    SmartType_String* s = parser->smarttype + id;
+    if (s->lists & flag)
+        return;
+
+    s->lists |= flag;
+    da_push_back((*list), id);
+
+    Parse_Visitor* visitor = parser->visitor;
+    if (visitor && visitor->on_smarttype)
+        visitor->on_smarttype(visitor->user, parser, flag, id);
 }
 
 static void push_character_name(Parser* parser, String line)
@@ -606,21 +988,19 @@ static void push_character_name(Parser* parser, String line)
             last_idx = i;
     }
 
-    String name = string_make_till_n(line, last_idx + 1);
-    push_unique_string_or_free(&parser->characters, &name);
+    push_smarttype(parser, &parser->characters, SMARTTYPE_CHARACTERS, line, last_idx + 1);
 }
 
 static void push_scene_heading_details(Parser* parser, String line)
 {
     int start_idx = 0;
-    while (!is_ws(line[start_idx]))
+    while (line[start_idx] && !is_ws(line[start_idx]))
         start_idx++;
 
     // There is a scene intro
-    if (line[start_idx - 1] == '.')
+    if (start_idx > 0 && line[start_idx - 1] == '.')
     {
-        String scene_intro = string_make_till_n(line, start_idx);
-        push_unique_string_or_free(&parser->scene_intros, &scene_intro);
+        push_smarttype(parser, &parser->scene_intros, SMARTTYPE_SCENE_INTRO, line, start_idx);
     }
     else
         start_idx = 0;
@@ -638,8 +1018,9 @@ static void push_scene_heading_details(Parser* parser, String line)
             last_idx = i;
     }
 
-    String location = string_make_till_n(line + start_idx , last_idx - start_idx + 1);
-    push_unique_string_or_free(&parser->locations, &location);
+    // Nothing between the scene intro and the '-'
+    if (last_idx >= start_idx)
+        push_smarttype(parser, &parser->locations, SMARTTYPE_LOCATION, line + start_idx, last_idx - start_idx + 1);
 
     if (line[i])
     {
@@ -647,16 +1028,93 @@ static void push_scene_heading_details(Parser* parser, String line)
         while (is_ws(line[start_idx]))
             start_idx++;
 
-        String time_of_day = string_make(line + start_idx);
-        push_unique_string_or_free(&parser->times_of_day, &time_of_day);
+        push_smarttype(parser, &parser->times_of_day, SMARTTYPE_TIME_OF_DAY, line + start_idx, strlen(line + start_idx));
     }
 }
 
-static void parse_screenplay(Parser* parser)
+// Where parser_edit can stop parsing, see there
+typedef struct _Parse_Resync
+{
+    Parse_Checkpoint* old;  // The old parse's checkpoints after the edit starts
+    int count;
+    int next;
+    int delta;              // Old offset + delta is the new offset
+    int from;               // Where the edit ends in the new content
+    int found;              // Index into old of where parsing stopped, -1 till then
+} Parse_Resync;
+
+// Called before a page break or scene heading at idx is taken. Returns 1 if
+// parser_edit got back in step with the old parse here and should stop.
+static int take_checkpoint(Parser* parser, int idx)
 {
-    int len = string_length(parser->content);
+    // Nothing to go back to
+    if (parser->visitor)
+        return 0;
+
+    Parse_Checkpoint cp = { idx, da_size(parser->elements), parser->prev_line_empty, parser->emphasis_flags };
+
+    Parse_Resync* resync = parser->resync;
+    if (resync && cp.idx >= resync->from)
+    {
+        while (resync->next < resync->count && resync->old[resync->next].idx + resync->delta < cp.idx)
+            resync->next++;
+
+        Parse_Checkpoint* old = resync->old + resync->next;
+        if (resync->next < resync->count && old->idx + resync->delta == cp.idx &&
+            old->prev_line_empty == cp.prev_line_empty && old->emphasis_flags == cp.emphasis_flags)
+        {
+            resync->found = resync->next;
+            return 1;
+        }
+    }
+
+    // parser_edit starts from one that's taken again
+    int count = da_size(parser->checkpoints);
+    if (count == 0 || parser->checkpoints[count - 1].idx != cp.idx)
+        da_push_back(parser->checkpoints, cp);
+
+    return 0;
+}
+
+static void collect_smarttype(Parser* parser, Elem* elems, int count);
+
+// Adds a finished element, or hands it to the visitor and frees it. Its
+// SmartType strings are collected after that so they stay in the arena.
+static void push_elem(Parser* parser, Elem e)
+{
+    Parse_Visitor* visitor = parser->visitor;
+    if (!visitor || parser->hold_elems)
+    {
+        da_push_back(parser->elements, e);
+        return;
+    }
+
+    if (visitor->on_elem)
+    {
+        stats_start(elem_timer);
+        visitor->on_elem(visitor->user, parser, &e);
+        stats_stop(elem_timer, STATS_FDX_ELEMENTS);
+    }
+
+    parser->visited_type = e.type;
+    arena_rewind(parser->arena, parser->visit_mark);
+
+    // Only the elements that have SmartType strings are worth two clock reads
+    if (e.type == ELEM_SCENE_HEADING || e.type == ELEM_CHARACTER || e.type == ELEM_TRANSITION)
+    {
+        stats_start(smarttype_timer);
+        collect_smarttype(parser, &e, 1);
+        stats_stop(smarttype_timer, STATS_SMARTTYPE);
+    }
+
+    parser->visit_mark = arena_mark(parser->arena);
+}
+
+// Parses the elements that start before end, the last one can run past it
+static void parse_screenplay(Parser* parser, int end)
+{
+    int len = parser->length;
 
-    parser->prev_line_empty = 1;
     while (parser->idx < len)
     {
         if (line_is_empty(parser))
@@ -664,7 +1122,7 @@ static void parse_screenplay(Parser* parser)
 
         consume_ws(parser);
 
-        if (parser->idx >= len)
+        if (parser->idx >= len || parser->idx >= end)
             return;
 
         if (peek(parser, 0) == '!')
@@ -679,8 +1137,11 @@ static void parse_screenplay(Parser* parser)
 
         if (line_starts_with(parser, "==="))
         {
+            if (take_checkpoint(parser, parser->idx))
+                return;
+
             Elem e = elem_make(ELEM_PAGE_BREAK);
-            da_push_back(parser->elements, e);
+            push_elem(parser, e);
             
             consume_line(parser);
             parser->prev_line_empty = 1;
@@ -690,15 +1151,14 @@ static void parse_screenplay(Parser* parser)
         if (line_starts_with(parser, "/*"))
         {
             Elem e = elem_make(ELEM_BONEYARD);
-            da_push_back(parser->elements, e);
+            push_elem(parser, e);
 
-            while (peek(parser, 0))
-            {
-                if (peek(parser, 0) == '*' && peek(parser, 1) == '/')
-                    break;
+            // Skip to the closing */, or the end if there isn't one
+            int at = next_mark(parser, parser->idx, len);
+            while (at < len && !(parser->content[at] == '*' && at + 1 < len && parser->content[at + 1] == '/'))
+                at = next_mark(parser, at + 1, len);
 
-                consume(parser);
-            }
+            parser->idx = at;
 
             consume(parser);
             consume(parser);
@@ -710,90 +1170,90 @@ static void parse_screenplay(Parser* parser)
         {
             consume(parser);        // Consume the first '>'
             consume_ws(parser);
-            String str = get_till_char(parser, '<');    // @Todo: Also trim off whitespaces at the end
+            da_clear(parser->pieces);
+            get_till_char(parser, '<');    // @Todo: Also trim off whitespaces at the end
             consume_line(parser);
 
             Elem e = elem_make(ELEM_CENTERED_TEXT);
-            da_push_back(parser->elements, e);
-            elem_process(&e, str, &parser->emphasis_flags);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
 
-            string_free(&str);
             parser->prev_line_empty = 0;
             continue;
         }
 
         if (is_parenthetical(parser))
         {
-            String str = get_line(parser);
+            da_clear(parser->pieces);
+            get_line(parser, 0);
 
             Elem e = elem_make(ELEM_PARENTHETICAL);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
 
-            string_free(&str);
             parser->prev_line_empty = 0;
             continue;
         }
 
         if (is_dialogue(parser))
         {
-            String str = get_multiline(parser);
+            da_clear(parser->pieces);
+            get_multiline(parser);
 
             Elem e = elem_make(ELEM_DIALOGUE);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
             
-            string_free(&str);
             parser->prev_line_empty = 0;
             continue;
         }
 
         if (is_transition(parser))
         {
-            String str = get_line(parser);
+            da_clear(parser->pieces);
+            get_line(parser, 0);
             
             if (line_is_empty(parser))
                 consume_line(parser);   // Consume the empty line after this
 
             Elem e = elem_make(ELEM_TRANSITION);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
-
-            String transition = NULL;
-            push_unique_string_or_free(&parser->transitions, &str);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
 
             parser->prev_line_empty = 1;
             continue;
         }
 
+        // is_scene_heading eats the '.' of a forced one
+        int heading_idx = parser->idx;
         if (is_scene_heading(parser))
         {
-            String str = get_line(parser);
+            if (take_checkpoint(parser, heading_idx))
+                return;
+
+            da_clear(parser->pieces);
+            get_line(parser, 0);
 
             if (line_is_empty(parser))
                 consume_line(parser);   // Consume the empty line after this
 
             Elem e = elem_make(ELEM_SCENE_HEADING);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
             
-            push_scene_heading_details(parser, str);
-            string_free(&str);
             parser->prev_line_empty = 1;
             continue;
         }
 
         if (is_character(parser))
         {
-            String str = get_line(parser);
+            da_clear(parser->pieces);
+            get_line(parser, 0);
 
             Elem e = elem_make(ELEM_CHARACTER);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
-         
-            push_character_name(parser, str);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
 
-            string_free(&str);
             parser->prev_line_empty = 0;
             continue;
         }
@@ -801,24 +1261,951 @@ static void parse_screenplay(Parser* parser)
     action: // Use a different way where it collects everything between elements
         
         {
-            String str = get_multiline(parser);
+            da_clear(parser->pieces);
+            get_multiline(parser);
 
             Elem e = elem_make(ELEM_ACTION);
-            elem_process(&e, str, &parser->emphasis_flags);
-            da_push_back(parser->elements, e);
+            elem_process(parser, &e, parser->pieces, da_size(parser->pieces));
+            push_elem(parser, e);
 
-            string_free(&str);
             parser->prev_line_empty = 0;
         }
     }
 }
 
-void parser_parse(Parser* parser)
+void parser_parse_elements(Parser* parser)
 {
     // Just in case
     parser->idx = 0;
+    build_line_index(parser);
+
+    parse_title_page(parser);
+
+    parser->prev_line_empty = 1;
+    take_checkpoint(parser, parser->idx);
+
+    stats_start(timer);
+    parse_screenplay(parser, parser->length);
+    stats_stop(timer, STATS_SCREENPLAY);
+}
+
+// The element's source without the '\r's, what get_line's pieces joined
+// together would come to. Doesn't use the marks so it works on old content too.
+static char* source_line(Parser* parser, Elem* elem)
+{
+    int n = elem->source_end - elem->source_start;
+    if ((int) da_cap(parser->chars) < n + 1)
+        da_resize(parser->chars, n + 1);
+
+    const char* src = parser->content + elem->source_start;
+    char* str = parser->chars;
+    int len = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (src[i] != '\r')
+            str[len++] = src[i];
+    }
+
+    str[len] = '\0';
+    return str;
+}
+
+// Goes over the single line elements again to fill the SmartType lists,
+// their source range is the whole line so this gets the same string the
+// parser saw.
+static void collect_smarttype(Parser* parser, Elem* elems, int count)
+{
+    for (Elem* elem = elems; elem < elems + count; elem++)
+    {
+        if (elem->type != ELEM_SCENE_HEADING && elem->type != ELEM_CHARACTER && elem->type != ELEM_TRANSITION)
+            continue;
+
+        char* line = source_line(parser, elem);
+        parser->smarttype_at = elem->source_start;
+
+        switch (elem->type)
+        {
+            case ELEM_SCENE_HEADING: push_scene_heading_details(parser, line); break;
+            case ELEM_CHARACTER:     push_character_name(parser, line); break;
+            default:
+                push_smarttype(parser, &parser->transitions, SMARTTYPE_TRANSITION, line, strlen(line));
+                break;
+        }
+    }
+}
+
+void parser_collect_smarttype(Parser* parser)
+{
+    stats_start(timer);
+    collect_smarttype(parser, parser->elements, da_size(parser->elements));
+    stats_stop(timer, STATS_SMARTTYPE);
+}
+
+void parser_parse(Parser* parser)
+{
+    parser_parse_elements(parser);
+    parser_collect_smarttype(parser);
+}
+
+void parser_parse_visit(Parser* parser, Parse_Visitor* visitor)
+{
+    parser->idx = 0;
+    build_line_index(parser);
+
+    parser->visitor = visitor;
+    parser->visited_type = -1;
+
+    parse_title_page(parser);
+    parser->prev_line_empty = 1;
+
+    // The title page stays, everything after this is freed element by element
+    parser->visit_mark = arena_mark(parser->arena);
+
+    stats_start(timer);
+    parse_screenplay(parser, parser->length);
+    stats_stop(timer, STATS_SCREENPLAY);
+
+    parser->visitor = NULL;
+}
+
+/*
+    Parallel parsing
+    The content after the title page is cut into chunks at lines where the
+    serial parser is almost always between elements: a scene heading after
+    an empty line, or a page break. Every chunk is parsed on its own as if
+    it was at the start of the screenplay, then they're stitched together
+    in order. A chunk's elements are only taken if the serial parser would
+    have started it in the same state, which is
+        - idx right at the chunk's start, a boneyard or anything else that
+          ran past the cut moves it further,
+        - prev_line_empty set, page breaks don't look at it,
+        - the last element isn't a character or a parenthetical, those
+          turn the next element into dialogue.
+    Otherwise the main parser parses that chunk again itself. emphasis_flags
+    is only ever toggled so every chunk starts with none and its texts get
+    the flags that were open before it xor'ed in.
+*/
+
+#ifndef PARSE_CHUNK_MIN_SIZE
+#define PARSE_CHUNK_MIN_SIZE (256 * 1024)
+#endif
+
+typedef struct _Parse_Chunk
+{
+    int start;
+    int end;
+    Parser parser;      // Borrows content, lines and marks from the main parser
+} Parse_Chunk;
+
+typedef struct _Parse_Work
+{
+    Parse_Chunk* chunks;
+    int count;
+    int next;           // Next chunk to be taken by a thread
+} Parse_Work;
+
+static int line_starts_with_str(Parser* parser, Line_Info* line, const char* str)
+{
+    int n = strlen(str);
+    return line->length >= n && memcmp(parser->content + line->start, str, n) == 0;
+}
+
+static int is_chunk_start(Parser* parser, Line_Info* line)
+{
+    if (line_starts_with_str(parser, line, "==="))
+        return 1;
+
+    if (!(line[-1].flags & LINE_EMPTY))
+        return 0;
+
+    return line_starts_with_str(parser, line, "INT.") ||
+           line_starts_with_str(parser, line, "EXT.") ||
+           (line->length >= 2 && parser->content[line->start] == '.' && is_alphabet(parser->content[line->start + 1]));
+}
+
+// Index of the line offset is in
+static int find_line(Parser* parser, int offset)
+{
+    int lo = 0, hi = da_size(parser->lines) - 1;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (parser->lines[mid].start <= offset) lo = mid;
+        else                                    hi = mid - 1;
+    }
+
+    return lo;
+}
+
+// Index of the first mark at or after offset
+static int find_mark(Parser* parser, int offset)
+{
+    int lo = 0, hi = da_size(parser->marks);
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (parser->marks[mid] < offset) lo = mid + 1;
+        else                             hi = mid;
+    }
+
+    return lo;
+}
+
+// First chunk start at or after offset, the end of the content if there isn't one
+static int find_chunk_start(Parser* parser, int offset)
+{
+    int count = da_size(parser->lines);
+
+    for (int l = find_line(parser, offset) + 1; l < count; l++)
+    {
+        if (is_chunk_start(parser, parser->lines + l))
+            return parser->lines[l].start;
+    }
+
+    return parser->length;
+}
+
+static void parse_chunk_worker(void* user)
+{
+    Parse_Work* work = (Parse_Work*) user;
+
+    while (1)
+    {
+        int k = atomic_fetch_add_int(&work->next, 1);
+        if (k >= work->count)
+            break;
+
+        Parse_Chunk* chunk = work->chunks + k;
+        Parser* parser = &chunk->parser;
+
+        parser->idx = chunk->start;
+        parser->prev_line_empty = 1;
+        parse_screenplay(parser, chunk->end);
+
+        collect_smarttype(parser, parser->elements, da_size(parser->elements));
+    }
+}
+
+static int chunk_in_sync(Parser* parser, Parse_Chunk* chunk)
+{
+    if (parser->idx != chunk->start)
+        return 0;
+
+    if (!parser->prev_line_empty && !line_starts_with(parser, "==="))
+        return 0;
+
+    int last = da_size(parser->elements) - 1;
+    return last < 0 || (parser->elements[last].type != ELEM_CHARACTER &&
+                         parser->elements[last].type != ELEM_PARENTHETICAL);
+}
+
+static void merge_smarttype_list(Parser* parser, Parser* chunk, DArray(int) list, DArray(int)* into, SmartType_List flag)
+{
+    da_foreach(int, id, list)
+    {
+        Interned str = intern_get(chunk->interned, *id);
+
+        int is_new;
+        int global = intern(&parser->interned, str.str, str.length, &is_new);
+        if (is_new)
+        {
+            SmartType_String s = chunk->smarttype[*id];
+            s.lists = 0;
+            da_push_back(parser->smarttype, s);
+        }
+
+        SmartType_String* s = parser->smarttype + global;
+        if (!(s->lists & flag))
+        {
+            s->lists |= flag;
+            da_push_back((*into), global);
+        }
+    }
+}
+
+static void merge_chunk(Parser* parser, Parse_Chunk* chunk)
+{
+    Parser* from = &chunk->parser;
+
+    // Open emphasis from before the chunk carries over into it
+    if (parser->emphasis_flags)
+    {
+        da_foreach(Elem, elem, from->elements)
+        {
+            for (int i = 0; i < elem->text_count; i++)
+                elem->texts[i].emphasis_flags ^= parser->emphasis_flags;
+        }
+    }
+
+    // Its checkpoints get the state the serial parser would have had at them,
+    // so parser_edit can start from them
+    int elem_count = da_size(parser->elements);
+    da_foreach(Parse_Checkpoint, from_cp, from->checkpoints)
+    {
+        Parse_Checkpoint cp = *from_cp;
+        cp.elem_count     += elem_count;
+        cp.emphasis_flags ^= parser->emphasis_flags;
+        if (cp.idx == chunk->start)
+            cp.prev_line_empty = parser->prev_line_empty;
+
+        int count = da_size(parser->checkpoints);
+        if (count == 0 || parser->checkpoints[count - 1].idx != cp.idx)
+            da_push_back(parser->checkpoints, cp);
+    }
+
+    da_append(parser->elements, from->elements, da_size(from->elements));
+
+    merge_smarttype_list(parser, from, from->characters,   &parser->characters,   SMARTTYPE_CHARACTERS);
+    merge_smarttype_list(parser, from, from->scene_intros, &parser->scene_intros, SMARTTYPE_SCENE_INTRO);
+    merge_smarttype_list(parser, from, from->locations,    &parser->locations,    SMARTTYPE_LOCATION);
+    merge_smarttype_list(parser, from, from->times_of_day, &parser->times_of_day, SMARTTYPE_TIME_OF_DAY);
+    merge_smarttype_list(parser, from, from->transitions,  &parser->transitions,  SMARTTYPE_TRANSITION);
+
+    parser->idx = from->idx;
+    parser->line = from->line;
+    parser->mark = from->mark;
+    parser->prev_line_empty = from->prev_line_empty;
+    parser->emphasis_flags ^= from->emphasis_flags;
+}
+
+void parser_parse_parallel(Parser* parser, int threads)
+{
+    parser->idx = 0;
+    build_line_index(parser);
+
+    parse_title_page(parser);
+    parser->prev_line_empty = 1;
+    take_checkpoint(parser, parser->idx);
+
+    // The chunks are all timed as one, the threads don't time anything
+    stats_start(timer);
+
+    // A couple of chunks per thread so an unlucky one doesn't hold the rest up
+    int length = parser->length - parser->idx;
+    int count = (threads > 1) ? threads * 2 : 1;
+    if (count > length / PARSE_CHUNK_MIN_SIZE)
+        count = length / PARSE_CHUNK_MIN_SIZE;
+
+    if (count < 2)
+    {
+        parse_screenplay(parser, parser->length);
+        stats_stop(timer, STATS_SCREENPLAY);
+
+        parser_collect_smarttype(parser);
+        return;
+    }
+
+    Parse_Chunk* chunks = (Parse_Chunk*) calloc(count, sizeof(Parse_Chunk));
+    hd_assert(chunks != NULL);
+
+    int start = parser->idx;
+    int made = 0;
+    for (int k = 0; k < count && start < parser->length; k++)
+    {
+        int end = (k + 1 < count) ? find_chunk_start(parser, parser->idx + (int) ((long long) length * (k + 1) / count)) : parser->length;
+        if (end <= start)
+            continue;
+
+        Parse_Chunk* chunk = chunks + made++;
+        chunk->start = start;
+        chunk->end   = end;
+
+        // Only its own arena and scratch, the line index is shared
+        chunk->parser = parser_make(parser->content, parser->length, NULL);
+        da_free(chunk->parser.lines);
+        da_free(chunk->parser.marks);
+        chunk->parser.lines = parser->lines;
+        chunk->parser.marks = parser->marks;
+
+        // Start the cursors at the chunk, they'd walk there from 0 otherwise
+        chunk->parser.line = find_line(parser, start);
+        chunk->parser.mark = find_mark(parser, start);
+
+        start = end;
+    }
+
+    Parse_Work work = { chunks, made, 0 };
+    threads_run(threads, parse_chunk_worker, &work);
+
+    for (int k = 0; k < made; k++)
+    {
+        Parse_Chunk* chunk = chunks + k;
+
+        if (chunk_in_sync(parser, chunk))
+        {
+            merge_chunk(parser, chunk);
+
+            // The chunk's texts and SmartType strings now belong to the main arena
+            arena_absorb(parser->arena, chunk->parser.arena);
+        }
+        else
+        {
+            int first = da_size(parser->elements);
+            parse_screenplay(parser, chunk->end);
+            collect_smarttype(parser, parser->elements + first, da_size(parser->elements) - first);
+        }
+
+        da_make(chunk->parser.lines);
+        da_make(chunk->parser.marks);
+        parser_free(&chunk->parser);
+    }
+
+    free(chunks);
+    stats_stop(timer, STATS_SCREENPLAY);
+}
+
+#ifndef PARSE_STREAM_BLOCK_SIZE
+#define PARSE_STREAM_BLOCK_SIZE (64 * 1024)
+#endif
+
+/*
+    Stream parsing
+    The input is read in blocks into a window and parsed up to a pause point,
+    the first non-ws char of a line after an empty line. That's where the
+    parser is between elements unless something ran across the empty line,
+    which shows as idx ending up past the pause point. Then the elements are
+    dropped and the window is parsed again with more input in it. Otherwise
+    they're handed to the visitor and the window moves on to the pause point.
+    Only the title page stays at the start of the window, the generators
+    read it at the end. So the window holds the title page and the longest
+    stretch without a pause point, a few paragraphs unless a boneyard runs on.
+*/
+
+typedef struct _Stream_Window
+{
+    char*  data;
+    size_t cap;
+    size_t filled;
+    int    keep;        // Bytes at the start that stay, the title page
+    int    eof;
+} Stream_Window;
+
+// Reads till the window has want more bytes or the input ends
+static void stream_fill(Stream_Window* window, Parse_Read read, void* user, size_t want)
+{
+    if (window->cap < window->filled + want)
+    {
+        size_t cap = window->cap ? window->cap : PARSE_STREAM_BLOCK_SIZE;
+        while (cap < window->filled + want)
+            cap *= 2;
+
+        window->data = (char*) realloc(window->data, cap);
+        hd_assert(window->data != NULL);
+        window->cap = cap;
+    }
+
+    size_t got = 0;
+    while (got < want)
+    {
+        size_t n = read(user, window->data + window->filled, want - got);
+        if (n == 0)
+        {
+            window->eof = 1;
+            break;
+        }
+
+        window->filled += n;
+        got += n;
+    }
+}
+
+// Indexes the window as if the input ended after its last whole line
+static void stream_index(Parser* parser, Stream_Window* window)
+{
+    int end = (int) window->filled;
+    if (!window->eof)
+    {
+        while (end > window->keep && window->data[end - 1] != '\n')
+            end--;
+    }
+
+    parser->content = window->data;
+    parser->length  = end;
+
+    da_clear(parser->lines);
+    da_clear(parser->marks);
+    index_range(parser, window->keep, end, 1);
+
+    parser->line = find_line(parser, parser->idx);
+    parser->mark = find_mark(parser, parser->idx);
+}
+
+// Last pause point after from, -1 if there isn't one. The empty line that
+// ends the index is left out, it's only there because the window ends.
+static int stream_pause_point(Parser* parser, int from)
+{
+    for (int l = da_size(parser->lines) - 2; l > 0; l--)
+    {
+        Line_Info* line = parser->lines + l;
+        if ((line->flags & LINE_EMPTY) || !(line[-1].flags & LINE_EMPTY))
+            continue;
+
+        int at = line->start + line->first;
+        return (at > from) ? at : -1;
+    }
+
+    return -1;
+}
+
+// Hands the elements to the visitor and forgets them
+static void stream_commit(Parser* parser)
+{
+    Parse_Visitor* visitor = parser->visitor;
+    int count = da_size(parser->elements);
+
+    if (visitor->on_elem)
+    {
+        stats_start(elem_timer);
+        for (int i = 0; i < count; i++)
+            visitor->on_elem(visitor->user, parser, parser->elements + i);
+        stats_stop(elem_timer, STATS_FDX_ELEMENTS);
+    }
+
+    if (count > 0)
+        parser->visited_type = parser->elements[count - 1].type;
+
+    arena_rewind(parser->arena, parser->visit_mark);
+
+    stats_start(smarttype_timer);
+    collect_smarttype(parser, parser->elements, count);
+    stats_stop(smarttype_timer, STATS_SMARTTYPE);
+
+    da_clear(parser->elements);
+    parser->visit_mark = arena_mark(parser->arena);
+}
+
+void parser_parse_stream(Parser* parser, Parse_Read read, void* user, Parse_Visitor* visitor)
+{
+    Stream_Window window = { 0 };
+    window.data = parser->stream_buffer;
+    window.cap  = parser->stream_cap;
+
+    parser->idx = 0;
+    parser->visitor = visitor;
+    parser->visited_type = -1;
+    parser->hold_elems = 1;
+
+    Arena_Mark start = arena_mark(parser->arena);
+    int start_emphasis = parser->emphasis_flags;
+    int title_done = 0;
+    size_t want = PARSE_STREAM_BLOCK_SIZE;
+
+    while (1)
+    {
+        if (!window.eof)
+            stream_fill(&window, read, user, want);
+
+        stream_index(parser, &window);
+
+        int stop = window.eof ? parser->length : stream_pause_point(parser, parser->idx);
+        if (stop < 0)
+        {
+            // Read more, twice as much every time so parsing again stays linear
+            want = window.filled;
+            continue;
+        }
+
+        if (!title_done)
+        {
+            // Tried without the visitor first, it can only see the final one
+            parser->visitor = NULL;
+            parse_title_page(parser);
+            parser->visitor = visitor;
+
+            int done = parser->idx;
+            map_clear(parser->title_page_details);
+            arena_rewind(parser->arena, start);
+            parser->idx = 0;
+            parser->emphasis_flags = start_emphasis;
+
+            if (!window.eof && done > stop)
+            {
+                want = window.filled;
+                continue;
+            }
+
+            parse_title_page(parser);
+            window.keep = parser->lines[find_line(parser, parser->idx)].start;
+
+            parser->prev_line_empty = 1;
+            parser->visit_mark = arena_mark(parser->arena);
+            title_done = 1;
+        }
+
+        int idx = parser->idx;
+        int prev_line_empty = parser->prev_line_empty;
+        int emphasis_flags = parser->emphasis_flags;
+
+        stats_start(timer);
+        parse_screenplay(parser, stop);
+        stats_stop(timer, STATS_SCREENPLAY);
+
+        if (!window.eof && parser->idx != stop)
+        {
+            // Something ran past the pause point, try again with more input
+            da_clear(parser->elements);
+            arena_rewind(parser->arena, parser->visit_mark);
+
+            parser->idx = idx;
+            parser->prev_line_empty = prev_line_empty;
+            parser->emphasis_flags = emphasis_flags;
+
+            want = window.filled;
+            continue;
+        }
+
+        stream_commit(parser);
+        if (window.eof)
+            break;
+
+        // Everything before the pause point's line is done with
+        int from = parser->lines[find_line(parser, stop)].start;
+        memmove(window.data + window.keep, window.data + from, window.filled - from);
+        window.filled -= from - window.keep;
+        parser->idx = window.keep + stop - from;
+
+        want = PARSE_STREAM_BLOCK_SIZE;
+    }
+
+    // Only the title page is still in the window, the visitor might want it
+    // after this so it's left to the parser. The map's keys point into the
+    // window, which moved every time it grew, so it's parsed again in place.
+    parser->content = window.data;
+    parser->length  = window.keep;
+    parser->stream_buffer = window.data;
+    parser->stream_cap    = window.cap;
+
+    int emphasis_flags = parser->emphasis_flags;
+    parser->visitor = NULL;
+    parser->emphasis_flags = start_emphasis;
+    map_clear(parser->title_page_details);
+    parser->idx = 0;
+    build_line_index(parser);
     parse_title_page(parser);
-    parse_screenplay(parser);
+    parser->emphasis_flags = emphasis_flags;
+
+    parser->hold_elems = 0;
+    parser->visitor = NULL;
+}
+
+/*
+    Incremental parsing
+    parser_edit throws away the elements from the last checkpoint before the
+    edited line on and parses from there with the checkpoint's state. Once
+    it's past the edit, every checkpoint it takes is compared against the
+    old parse's, shifted by how much the content grew. When idx, the empty
+    line flag and the open emphasis all match the rest would come out the
+    same, so the old elements from there are kept and only their offsets
+    are moved. The line index is only rebuilt for the edited lines too.
+*/
+
+static void recount_smarttype(Parser* parser)
+{
+    da_clear(parser->characters);
+    da_clear(parser->scene_intros);
+    da_clear(parser->locations);
+    da_clear(parser->times_of_day);
+    da_clear(parser->transitions);
+
+    da_foreach(SmartType_String, s, parser->smarttype)
+        s->lists = 0;
+
+    da_clear(parser->smarttype_refs);
+    parser->smarttype_lost = 0;
+
+    parser->smarttype_delta = 1;
+    collect_smarttype(parser, parser->elements, da_size(parser->elements));
+    parser->smarttype_delta = 0;
+
+    parser->smarttype_counted = 1;
+}
+
+// Swaps the index of the lines the edit touched for the new content's
+static void splice_line_index(Parser* parser, char* content, int length, int start, int old_end, int delta)
+{
+    int first = find_line(parser, start);
+    int last  = find_line(parser, old_end);
+    int has_next = last + 1 < (int) da_size(parser->lines);
+
+    int from   = parser->lines[first].start;
+    int old_to = has_next ? parser->lines[last + 1].start : parser->length;
+
+    da_clear(parser->old_lines);
+    da_clear(parser->old_marks);
+
+    if (has_next)
+    {
+        for (int m = find_mark(parser, old_to); m < (int) da_size(parser->marks); m++)
+            da_push_back(parser->old_marks, parser->marks[m] + delta);
+
+        for (int l = last + 1; l < (int) da_size(parser->lines); l++)
+        {
+            Line_Info line = parser->lines[l];
+            line.start += delta;
+            da_push_back(parser->old_lines, line);
+        }
+    }
+
+    da_truncate(parser->marks, find_mark(parser, from));
+    da_truncate(parser->lines, first);
+
+    parser->content = content;
+    parser->length  = length;
+
+    index_range(parser, from, has_next ? old_to + delta : length, !has_next);
+
+    da_append(parser->lines, parser->old_lines, da_size(parser->old_lines));
+    da_append(parser->marks, parser->old_marks, da_size(parser->old_marks));
+}
+
+static void shift_elem(Elem* elem, int delta)
+{
+    // Page breaks and boneyards never got a source range
+    if (elem->source_end > 0)
+    {
+        elem->source_start += delta;
+        elem->source_end   += delta;
+    }
+
+    for (int i = 0; i < elem->text_count; i++)
+    {
+        Text* t = elem->texts + i;
+        for (int k = 0; k < t->span_count; k++)
+            t->spans[k].offset += delta;
+    }
+}
+
+// The title page is before every checkpoint so an edit that parser_edit
+// doesn't parse from scratch never touches it, its keys only have to point
+// into the new content
+static void move_title_page_keys(Parser* parser, char* content)
+{
+    map_foreach(parser->title_page_details, i)
+    {
+        Map_Key* key = &map_key(parser->title_page_details, i);
+        key->str = content + (key->str - parser->content);
+    }
+}
+
+void parser_edit(Parser* parser, char* content, size_t length, int start, int old_end, int new_end)
+{
+    int delta = new_end - old_end;
+    hd_assert(0 <= start && start <= old_end && old_end <= parser->length && start <= new_end);
+    hd_assert((int) length == parser->length + delta);
+
+    // Last checkpoint before the edited line, anything from there on can change
+    int cp = -1;
+    if (da_size(parser->lines) > 0)
+    {
+        int line_start = parser->lines[find_line(parser, start)].start;
+        for (int k = da_size(parser->checkpoints) - 1; k >= 0; k--)
+        {
+            if (parser->checkpoints[k].idx < line_start)
+            {
+                cp = k;
+                break;
+            }
+        }
+    }
+
+    if (cp < 0)
+    {
+        parser_reset(parser, content, length);
+        parser_parse(parser);
+        return;
+    }
+
+    if (!parser->smarttype_counted)
+        recount_smarttype(parser);
+
+    Parse_Checkpoint at = parser->checkpoints[cp];
+    char* old_content = parser->content;
+
+    int elem_count = da_size(parser->elements);
+    int old_idx = parser->idx;
+    int old_prev_line_empty = parser->prev_line_empty;
+    int old_emphasis_flags = parser->emphasis_flags;
+
+    da_clear(parser->old_elements);
+    da_append(parser->old_elements, parser->elements + at.elem_count, elem_count - at.elem_count);
+    da_truncate(parser->elements, at.elem_count);
+
+    da_clear(parser->old_checkpoints);
+    da_append(parser->old_checkpoints, parser->checkpoints + cp + 1, da_size(parser->checkpoints) - cp - 1);
+    da_truncate(parser->checkpoints, cp + 1);
+
+    move_title_page_keys(parser, content);
+    splice_line_index(parser, content, (int) length, start, old_end, delta);
+
+    Parse_Resync resync = { parser->old_checkpoints, da_size(parser->old_checkpoints), 0, delta, new_end, -1 };
+    parser->resync = &resync;
+
+    parser->idx = at.idx;
+    parser->prev_line_empty = at.prev_line_empty;
+    parser->emphasis_flags  = at.emphasis_flags;
+    parser->line = find_line(parser, at.idx);
+    parser->mark = find_mark(parser, at.idx);
+
+    parse_screenplay(parser, parser->length);
+    parser->resync = NULL;
+
+    // Old elements before kept_from were parsed again, the rest stay
+    int old_count = da_size(parser->old_elements);
+    int kept_from = old_count;
+    int old_stop  = parser->length - delta;
+    if (resync.found >= 0)
+    {
+        Parse_Checkpoint stop = parser->old_checkpoints[resync.found];
+        kept_from = stop.elem_count - at.elem_count;
+        old_stop  = stop.idx;
+    }
+
+    int new_count = da_size(parser->elements) - at.elem_count;
+
+    // SmartType strings of the kept elements move along with them
+    da_foreach(SmartType_Ref, ref, parser->smarttype_refs)
+    {
+        if (ref->count > 0 && ref->first >= old_stop)
+            ref->first += delta;
+    }
+
+    parser->content = old_content;
+    parser->smarttype_delta = -1;
+    collect_smarttype(parser, parser->old_elements, kept_from);
+
+    parser->content = content;
+    parser->smarttype_delta = 1;
+    collect_smarttype(parser, parser->elements + at.elem_count, new_count);
+    parser->smarttype_delta = 0;
+
+    for (int i = kept_from; i < old_count; i++)
+    {
+        Elem* elem = parser->old_elements + i;
+        shift_elem(elem, delta);
+        da_push_back(parser->elements, *elem);
+    }
+
+    if (resync.found >= 0)
+    {
+        for (int k = resync.found; k < resync.count; k++)
+        {
+            Parse_Checkpoint c = parser->old_checkpoints[k];
+            c.idx += delta;
+            c.elem_count += new_count - kept_from;
+            da_push_back(parser->checkpoints, c);
+        }
+
+        parser->idx = old_idx + delta;
+        parser->prev_line_empty = old_prev_line_empty;
+        parser->emphasis_flags  = old_emphasis_flags;
+    }
+
+    // A string lost its first element and no new one has it
+    if (parser->smarttype_lost > 0)
+        recount_smarttype(parser);
+
+#ifdef PARSER_VERIFY_EDITS
+    Parser full = parser_make(content, length, NULL);
+    parser_parse(&full);
+    hd_assert(parser_same_result(parser, &full));
+    parser_free(&full);
+#endif
+}
+
+static int same_spans(Span* x, Span* y, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (x[i].offset != y[i].offset || x[i].length != y[i].length || x[i].lead != y[i].lead)
+            return 0;
+    }
+
+    return 1;
+}
+
+static int same_elem(Elem* x, Elem* y)
+{
+    if (x->type != y->type || x->text_count != y->text_count ||
+        x->source_start != y->source_start || x->source_end != y->source_end)
+        return 0;
+
+    for (int i = 0; i < x->text_count; i++)
+    {
+        Text* s = x->texts + i;
+        Text* t = y->texts + i;
+        if (s->emphasis_flags != t->emphasis_flags || s->span_count != t->span_count ||
+            !same_spans(s->spans, t->spans, s->span_count))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int same_list(Parser* a, DArray(int) x, Parser* b, DArray(int) y)
+{
+    if (da_size(x) != da_size(y))
+        return 0;
+
+    for (int i = 0; i < (int) da_size(x); i++)
+    {
+        Interned s = intern_get(a->interned, x[i]);
+        Interned t = intern_get(b->interned, y[i]);
+        if (s.length != t.length || memcmp(s.str, t.str, s.length) != 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+// Keys are only compared by their bytes, they could still point into
+// content that's gone
+static int keys_in_content(Parser* parser)
+{
+    map_foreach(parser->title_page_details, i)
+    {
+        Map_Key key = map_key(parser->title_page_details, i);
+        if (key.str < parser->content || key.str + key.length > parser->content + parser->length)
+            return 0;
+    }
+
+    return 1;
+}
+
+int parser_same_result(Parser* a, Parser* b)
+{
+    if (a->length != b->length || memcmp(a->content, b->content, a->length) != 0)
+        return 0;
+
+    if (da_size(a->elements) != da_size(b->elements))
+        return 0;
+
+    for (int i = 0; i < (int) da_size(a->elements); i++)
+    {
+        if (!same_elem(a->elements + i, b->elements + i))
+            return 0;
+    }
+
+    if (map_count(a->title_page_details) != map_count(b->title_page_details))
+        return 0;
+
+    if (!keys_in_content(a) || !keys_in_content(b))
+        return 0;
+
+    map_foreach(a->title_page_details, i)
+    {
+        Map_Key key = map_key(a->title_page_details, i);
+        Elem* elem  = map_value(a->title_page_details, i);
+        Elem* other = map_find(b->title_page_details, key.str, key.length);
+        if (!other || !same_elem(elem, other))
+            return 0;
+    }
+
+    return same_list(a, a->characters,   b, b->characters)   &&
+           same_list(a, a->scene_intros, b, b->scene_intros) &&
+           same_list(a, a->locations,    b, b->locations)    &&
+           same_list(a, a->times_of_day, b, b->times_of_day) &&
+           same_list(a, a->transitions,  b, b->transitions);
 }
 
 char* elem_type_as_string(Elem e)
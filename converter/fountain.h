@@ -2,7 +2,9 @@
 
 #include "containers/string.h"
 #include "containers/darray.h"
-#include "containers/dictionary.h"
+#include "containers/hash_map.h"
+#include "containers/arena.h"
+#include "containers/intern.h"
 
 // @Todo: Figure out how Script notes work in Final Draft
 // @Todo: Boneyards can only work if lines start with /*.
@@ -29,34 +31,169 @@ typedef enum _Emphasis_Type
     EMPHASIS_UNDERLINED = 0x04,
 } Emphasis_Type;
 
+// A run of chars in the parser's content. lead is a char that goes before
+// the run, 0 if there isn't one. Lines that get joined (multiline action and
+// dialogue, title page values) are kept as spans with a ' ' or '\n' lead
+// instead of being copied together.
+typedef struct _Span
+{
+    int offset;
+    int length;
+    char lead;
+} Span;
+
 typedef struct _Text
 {
     int emphasis_flags;
-    String text;
+    Span* spans;
+    int span_count;
 } Text;
 
+// texts and their spans are allocated from the parser's arena
 typedef struct _Elem
 {
     Elem_Type type;
-    DArray(Text) texts;
+    Text* texts;
+    int text_count;
+
+    int source_start;   // Range of content the text was taken from
+    int source_end;
 } Elem;
 
-Elem elem_make(Elem_Type type);
-void elem_process(Elem* elem, String line, int* emphasis_flags);
-void elem_free(Elem* elem);
+typedef enum _Line_Flags
+{
+    LINE_EMPTY    = 0x01,   // Only whitespace
+    LINE_ALL_CAPS = 0x02,   // No lowercase letters
+    LINE_INDENTED = 0x04,   // Starts with a tab or 3 spaces
+} Line_Flags;
+
+// Per line metadata computed in a single pass before parsing so
+// lookahead never has to rescan the content.
+// first/last are relative to start and point at non-ws chars.
+typedef struct _Line_Info
+{
+    int start;
+    int length;         // Excluding the '\n'
+    int first;          // length if the line is empty
+    int last;           // -1 if the line is empty
+    int last_lower;     // Last lowercase letter, -1 if there are none
+    int flags;
+} Line_Info;
+
+// Which SmartType lists a string is in
+typedef enum _SmartType_List
+{
+    SMARTTYPE_CHARACTERS  = 0x01,
+    SMARTTYPE_SCENE_INTRO = 0x02,
+    SMARTTYPE_LOCATION    = 0x04,
+    SMARTTYPE_TIME_OF_DAY = 0x08,
+    SMARTTYPE_TRANSITION  = 0x10,
+} SmartType_List;
+
+#define SMARTTYPE_LIST_COUNT 5
+
+typedef struct _SmartType_String
+{
+    const char* escaped;    // Escaped once when it's first seen, in the arena
+    int escaped_length;
+    int lists;
+} SmartType_String;
+
+// How many elements put a string in one of the lists, and the source offset
+// of the first of them. Only kept once a parser is edited.
+typedef struct _SmartType_Ref
+{
+    int count;
+    int first;      // -1 while parser_edit doesn't know
+} SmartType_Ref;
+
+// The parser's state between two elements, parsing can start again from any
+// of these. One is taken at the start of the body and at every page break
+// and scene heading.
+typedef struct _Parse_Checkpoint
+{
+    int idx;
+    int elem_count;     // Elements before it
+    int prev_line_empty;
+    int emphasis_flags;
+} Parse_Checkpoint;
+
+struct _Parser;
+
+// Reads up to size bytes into buffer, returns how many, 0 only at the end
+typedef size_t (*Parse_Read)(void* user, char* buffer, size_t size);
+
+// For parsing without keeping the elements around. The parser calls these as
+// it goes, any of them can be NULL.
+//   on_elem gets every element as soon as it's done. The element, its texts
+//   and spans are freed right after the call so copy out what's needed.
+//   on_title_page gets every title page entry. These are kept in
+//   title_page_details like they are for a normal parse.
+//   on_smarttype gets a string the first time it goes into one of the lists,
+//   it's parser->smarttype[id] and stays there till the parser is reset.
+typedef struct _Parse_Visitor
+{
+    void* user;
+    void (*on_elem)(void* user, struct _Parser* parser, Elem* elem);
+    void (*on_title_page)(void* user, struct _Parser* parser, const char* key, int key_length, Elem* value);
+    void (*on_smarttype)(void* user, struct _Parser* parser, SmartType_List list, int id);
+} Parse_Visitor;
 
 typedef struct _Parser
 {
-    String content;
+    char* content;  // Not owned and not NUL terminated, only read through length
+    int length;
     int idx;
-    Dict(Elem)   title_page_details;
+
+    DArray(Line_Info) lines;
+    int line;       // Line that idx is in, only moves when asked for
+
+    DArray(int) marks;  // Offsets of the structural chars found by the scanner, in order
+    int mark;           // Cursor into marks, same as line
+
+    Arena* arena;       // Texts, spans and the SmartType strings live here
+    int owns_arena;
+
+    DArray(Span) pieces;    // Scratch, the spans of the element being parsed
+    DArray(Span) spans;     // Scratch, the spans of the texts being made from pieces
+    DArray(Text) texts;     // Scratch, the texts being made from pieces
+    DArray(char) chars;     // Scratch, source lines without their '\r's
+
+    Map(Elem)    title_page_details;  // Keys point into content
     DArray(Elem) elements;
 
-    DArray(String) characters;
-    DArray(String) scene_intros;
-    DArray(String) locations;
-    DArray(String) times_of_day;
-    DArray(String) transitions;
+    Intern_Table interned;              // SmartType strings
+    DArray(SmartType_String) smarttype; // Indexed by interned id
+
+    // Interned ids, in the order they were first seen
+    DArray(int) characters;
+    DArray(int) scene_intros;
+    DArray(int) locations;
+    DArray(int) times_of_day;
+    DArray(int) transitions;
+
+    DArray(Parse_Checkpoint) checkpoints;  // In order
+
+    DArray(SmartType_Ref) smarttype_refs;   // SMARTTYPE_LIST_COUNT per interned id
+    int smarttype_counted;  // smarttype_refs are up to date
+    int smarttype_delta;    // What collect_smarttype adds to the refs, 0 when it only adds to the lists
+    int smarttype_at;       // Source offset of the element collect_smarttype is at
+    int smarttype_lost;     // Refs with a count but no first
+
+    // Scratch for parser_edit, what came after the edit in the old parse
+    DArray(Line_Info) old_lines;
+    DArray(int) old_marks;
+    DArray(Elem) old_elements;
+    DArray(Parse_Checkpoint) old_checkpoints;
+    struct _Parse_Resync* resync;   // Only set while parser_edit parses
+
+    Parse_Visitor* visitor;     // Only set while parser_parse_visit or parser_parse_stream parses
+    Arena_Mark visit_mark;      // Where the arena goes back to after every element
+    int visited_type;           // Type of the last element visited, -1 before the first
+    int hold_elems;             // Elements go into elements even with a visitor, till it's known they're final
+
+    char* stream_buffer;        // Window parser_parse_stream reads into, kept for the next one
+    size_t stream_cap;
 
     int prev_line_empty;
     int next_line_empty;
@@ -64,8 +201,50 @@ typedef struct _Parser
     int emphasis_flags;
 } Parser;
 
-Parser parser_make(String content);
+Elem elem_make(Elem_Type type);
+void elem_process(Parser* parser, Elem* elem, Span* pieces, int count);
+
+// The parser allocates from arena and resets it in parser_reset and
+// parser_free, so one arena can be reused across conversions. Pass NULL to
+// have the parser own one.
+Parser parser_make(char* content, size_t length, Arena* arena);
 void parser_free(Parser* parser);
+
+// Gets the parser ready for another screenplay, everything from the last one
+// is gone but the arrays and the arena keep their memory
+void parser_reset(Parser* parser, char* content, size_t length);
 void parser_parse(Parser* parser);
 
+// parser_parse is these two in order, they're split so each can be timed
+void parser_parse_elements(Parser* parser);
+void parser_collect_smarttype(Parser* parser);
+
+// Same result as parser_parse, content after the title page is parsed on up
+// to threads threads. Small screenplays are parsed serially.
+void parser_parse_parallel(Parser* parser, int threads);
+
+// Same as parser_parse but the elements go to the visitor instead of into
+// elements, which stays empty. Memory doesn't grow with the elements, only
+// with the title page and the SmartType strings. The parser has to be new or
+// reset, and parser_edit can't be used on the result.
+void parser_parse_visit(Parser* parser, Parse_Visitor* visitor);
+
+// parser_parse_visit on input that's read as it's parsed, it doesn't have to
+// be all there first. Only a window of it is kept, a few paragraphs in size.
+// Afterwards content is only the title page, in a buffer the parser owns.
+void parser_parse_stream(Parser* parser, Parse_Read read, void* user, Parse_Visitor* visitor);
+
+// Updates a parsed parser for an edit, content is the whole screenplay after
+// [start, old_end) of the old content was replaced with [start, new_end).
+// Parsing starts again at the last checkpoint before the edit and stops at
+// the first one after it where the parser is in the same state as before,
+// the elements after that are only moved. Comes out the same as parsing
+// content from scratch. The old content has to still be there during the call,
+// afterwards nothing points into it and it can be freed.
+// Building with PARSER_VERIFY_EDITS checks every edit against a full parse.
+void parser_edit(Parser* parser, char* content, size_t length, int start, int old_end, int new_end);
+
+// 1 if both have the same content, elements, title page and SmartType lists
+int parser_same_result(Parser* a, Parser* b);
+
 char* elem_type_as_string(Elem e);
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include "ir.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "sink.h"
+#include "containers/hash.h"
+#include "containers/hd_assert.h"
+
+// Sections start at multiples of this so the records in them are aligned
+#define IR_ALIGNMENT 8
+
+// The SmartType lists, in the order parser_lists gives them
+#define IR_LIST_COUNT 5
+
+static const char ir_magic[4] = { 'F', 'F', 'I', 'R' };
+
+// Every field is 32 or 64 bits so there's no padding anywhere
+typedef struct _IR_Header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t check_hash;    // ir_check_hash of everything after it, the rest of the header included
+    uint32_t byte_order;    // 0x01020304 as written
+    uint32_t span_size;     // sizeof(Span), spans are stored as they are in memory
+
+    uint64_t source_hash;
+    uint64_t file_size;
+
+    uint32_t content_length;
+    uint32_t span_count;
+    uint32_t text_count;
+    uint32_t elem_count;
+    uint32_t title_count;
+    uint32_t smarttype_count;
+    uint32_t string_bytes;
+    uint32_t list_counts[IR_LIST_COUNT];    // Characters, scene intros, locations, times of day, transitions
+
+    // Offsets from the start of the file
+    uint64_t content_offset;
+    uint64_t span_offset;
+    uint64_t text_offset;
+    uint64_t elem_offset;
+    uint64_t title_offset;
+    uint64_t smarttype_offset;
+    uint64_t string_offset;
+    uint64_t list_offset;
+} IR_Header;
+
+typedef struct _IR_Text
+{
+    int32_t emphasis_flags;
+    int32_t first_span;
+    int32_t span_count;
+} IR_Text;
+
+typedef struct _IR_Elem
+{
+    int32_t type;
+    int32_t first_text;
+    int32_t text_count;
+    int32_t source_start;
+    int32_t source_end;
+} IR_Elem;
+
+typedef struct _IR_Title
+{
+    int32_t key_offset;     // Into the content
+    int32_t key_length;
+    IR_Elem elem;
+} IR_Title;
+
+typedef struct _IR_SmartType
+{
+    int32_t name_offset;    // Into the strings, the interned string
+    int32_t name_length;
+    int32_t escaped_offset;
+    int32_t escaped_length;
+    int32_t lists;
+} IR_SmartType;
+
+uint64_t ir_source_hash(const char* content, size_t length)
+{
+    return hash_bytes(content, length, IR_VERSION);
+}
+
+// The offsets and counts are checked on load but the bytes they point at can't
+// be, a damaged file that still looks right is caught by this instead
+static uint64_t ir_check_hash(const char* file, uint64_t file_size)
+{
+    size_t start = offsetof(IR_Header, check_hash) + sizeof(uint64_t);
+    return hash_bytes(file + start, (size_t) file_size - start, IR_VERSION);
+}
+
+static uint64_t ir_align(uint64_t offset)
+{
+    return (offset + IR_ALIGNMENT - 1) & ~(uint64_t) (IR_ALIGNMENT - 1);
+}
+
+/*
+    Saving
+*/
+
+static void parser_lists(Parser* parser, DArray(int)* lists[IR_LIST_COUNT])
+{
+    lists[0] = &parser->characters;
+    lists[1] = &parser->scene_intros;
+    lists[2] = &parser->locations;
+    lists[3] = &parser->times_of_day;
+    lists[4] = &parser->transitions;
+}
+
+// Pads the sink up to offset
+static void write_padding(Sink* sink, uint64_t* at, uint64_t offset)
+{
+    static const char zeros[IR_ALIGNMENT] = { 0 };
+    sink_write(sink, zeros, (size_t) (offset - *at));
+    *at = offset;
+}
+
+static void write_section(Sink* sink, uint64_t* at, uint64_t offset, const void* data, size_t size)
+{
+    write_padding(sink, at, offset);
+    sink_write(sink, (const char*) data, size);
+    *at += size;
+}
+
+// Spans one at a time, their padding isn't written from memory so files come out the same every time
+static void write_spans(Sink* sink, Elem* elem)
+{
+    for (int t = 0; t < elem->text_count; t++)
+    {
+        Text* text = elem->texts + t;
+        for (int i = 0; i < text->span_count; i++)
+        {
+            Span span;
+            memset(&span, 0, sizeof(span));
+            span.offset = text->spans[i].offset;
+            span.length = text->spans[i].length;
+            span.lead   = text->spans[i].lead;
+
+            sink_write(sink, (const char*) &span, sizeof(span));
+        }
+    }
+}
+
+// Texts of elem, their spans are numbered on from *span
+static void write_texts(Sink* sink, Elem* elem, int* span)
+{
+    for (int t = 0; t < elem->text_count; t++)
+    {
+        IR_Text record = { elem->texts[t].emphasis_flags, *span, elem->texts[t].span_count };
+        sink_write(sink, (const char*) &record, sizeof(record));
+
+        *span += record.span_count;
+    }
+}
+
+int ir_save(Parser* parser, const char* filepath)
+{
+    IR_Header header = { 0 };
+    memcpy(header.magic, ir_magic, sizeof(ir_magic));
+    header.version     = IR_VERSION;
+    header.byte_order  = 0x01020304;
+    header.span_size   = sizeof(Span);
+    header.source_hash = ir_source_hash(parser->content, parser->length);
+
+    header.content_length = parser->length;
+    header.elem_count     = da_size(parser->elements);
+    header.title_count    = (uint32_t) map_count(parser->title_page_details);
+
+    // Body elements first, then the title page, spans and texts are numbered in that order
+    da_foreach(Elem, elem, parser->elements)
+    {
+        header.text_count += elem->text_count;
+        for (int t = 0; t < elem->text_count; t++)
+            header.span_count += elem->texts[t].span_count;
+    }
+
+    map_foreach(parser->title_page_details, i)
+    {
+        Elem* elem = map_value(parser->title_page_details, i);
+        header.text_count += elem->text_count;
+        for (int t = 0; t < elem->text_count; t++)
+            header.span_count += elem->texts[t].span_count;
+    }
+
+    header.smarttype_count = da_size(parser->smarttype);
+    for (int i = 0; i < (int) header.smarttype_count; i++)
+        header.string_bytes += intern_get(parser->interned, i).length + parser->smarttype[i].escaped_length;
+
+    DArray(int)* lists[IR_LIST_COUNT];
+    parser_lists(parser, lists);
+
+    uint64_t list_bytes = 0;
+    for (int l = 0; l < IR_LIST_COUNT; l++)
+    {
+        header.list_counts[l] = da_size(*lists[l]);
+        list_bytes += header.list_counts[l] * sizeof(int32_t);
+    }
+
+    header.content_offset   = ir_align(sizeof(IR_Header));
+    header.span_offset      = ir_align(header.content_offset + header.content_length);
+    header.text_offset      = ir_align(header.span_offset + (uint64_t) header.span_count * sizeof(Span));
+    header.elem_offset      = ir_align(header.text_offset + (uint64_t) header.text_count * sizeof(IR_Text));
+    header.title_offset     = ir_align(header.elem_offset + (uint64_t) header.elem_count * sizeof(IR_Elem));
+    header.smarttype_offset = ir_align(header.title_offset + (uint64_t) header.title_count * sizeof(IR_Title));
+    header.string_offset    = ir_align(header.smarttype_offset + (uint64_t) header.smarttype_count * sizeof(IR_SmartType));
+    header.list_offset      = ir_align(header.string_offset + header.string_bytes);
+    header.file_size        = header.list_offset + list_bytes;
+
+    // Mapped so the check hash can go in once the rest is written
+    Mapped_Output output;
+    if (!map_output_file(filepath, (size_t) header.file_size, &output))
+        return 0;
+
+    Sink sink = sink_make_fixed(output.data, (size_t) header.file_size);
+
+    uint64_t at = 0;
+    write_section(&sink, &at, 0, &header, sizeof(header));
+    write_section(&sink, &at, header.content_offset, parser->content, header.content_length);
+
+    write_padding(&sink, &at, header.span_offset);
+    da_foreach(Elem, elem, parser->elements)
+        write_spans(&sink, elem);
+    map_foreach(parser->title_page_details, i)
+        write_spans(&sink, map_value(parser->title_page_details, i));
+    at += (uint64_t) header.span_count * sizeof(Span);
+
+    // The texts go out now, the elements that point at them after
+    write_padding(&sink, &at, header.text_offset);
+    int span = 0;
+    da_foreach(Elem, elem, parser->elements)
+        write_texts(&sink, elem, &span);
+    map_foreach(parser->title_page_details, i)
+        write_texts(&sink, map_value(parser->title_page_details, i), &span);
+    at += (uint64_t) header.text_count * sizeof(IR_Text);
+
+    write_padding(&sink, &at, header.elem_offset);
+    int text = 0;
+    da_foreach(Elem, elem, parser->elements)
+    {
+        IR_Elem record = { (int32_t) elem->type, text, elem->text_count, elem->source_start, elem->source_end };
+        sink_write(&sink, (const char*) &record, sizeof(record));
+        text += elem->text_count;
+    }
+    at += (uint64_t) header.elem_count * sizeof(IR_Elem);
+
+    write_padding(&sink, &at, header.title_offset);
+    map_foreach(parser->title_page_details, i)
+    {
+        Map_Key key = map_key(parser->title_page_details, i);
+        Elem* elem = map_value(parser->title_page_details, i);
+
+        IR_Title record = { (int32_t) (key.str - parser->content), key.length,
+                            { (int32_t) elem->type, text, elem->text_count, elem->source_start, elem->source_end } };
+        sink_write(&sink, (const char*) &record, sizeof(record));
+        text += elem->text_count;
+    }
+    at += (uint64_t) header.title_count * sizeof(IR_Title);
+
+    write_padding(&sink, &at, header.smarttype_offset);
+    int32_t string_at = 0;
+    for (int i = 0; i < (int) header.smarttype_count; i++)
+    {
+        Interned name = intern_get(parser->interned, i);
+        SmartType_String* s = parser->smarttype + i;
+
+        IR_SmartType record = { string_at, name.length, string_at + name.length, s->escaped_length, s->lists };
+        sink_write(&sink, (const char*) &record, sizeof(record));
+        string_at += name.length + s->escaped_length;
+    }
+    at += (uint64_t) header.smarttype_count * sizeof(IR_SmartType);
+
+    write_padding(&sink, &at, header.string_offset);
+    for (int i = 0; i < (int) header.smarttype_count; i++)
+    {
+        Interned name = intern_get(parser->interned, i);
+        sink_write(&sink, name.str, name.length);
+        sink_write(&sink, parser->smarttype[i].escaped, parser->smarttype[i].escaped_length);
+    }
+    at += header.string_bytes;
+
+    write_padding(&sink, &at, header.list_offset);
+    for (int l = 0; l < IR_LIST_COUNT; l++)
+    {
+        // int is 32 bits everywhere this builds
+        sink_write(&sink, (const char*) *lists[l], header.list_counts[l] * sizeof(int32_t));
+    }
+
+    int ok = sink_close(&sink) && sink.offset == (long long) header.file_size;
+    if (ok)
+    {
+        header.check_hash = ir_check_hash(output.data, header.file_size);
+        memcpy(output.data, &header, sizeof(header));
+    }
+
+    return unmap_output_file(&output, OUTPUT_SYNC_NONE) && ok;
+}
+
+/*
+    Loading
+    Nothing in the file is trusted, every count and offset is checked
+    against the file before anything points into it.
+*/
+
+static int section_fits(IR_Header* header, uint64_t offset, uint64_t count, size_t size)
+{
+    return offset % IR_ALIGNMENT == 0 && offset <= header->file_size &&
+           count <= (header->file_size - offset) / size;
+}
+
+static int header_valid(IR_Header* header, size_t file_size)
+{
+    if (memcmp(header->magic, ir_magic, sizeof(ir_magic)) != 0 || header->version != IR_VERSION ||
+        header->byte_order != 0x01020304 || header->span_size != sizeof(Span) ||
+        header->file_size != file_size || header->content_length > 0x7FFFFFFF)
+        return 0;
+
+    uint64_t list_count = 0;
+    for (int l = 0; l < IR_LIST_COUNT; l++)
+        list_count += header->list_counts[l];
+
+    return section_fits(header, header->content_offset, header->content_length, 1) &&
+           section_fits(header, header->span_offset, header->span_count, sizeof(Span)) &&
+           section_fits(header, header->text_offset, header->text_count, sizeof(IR_Text)) &&
+           section_fits(header, header->elem_offset, header->elem_count, sizeof(IR_Elem)) &&
+           section_fits(header, header->title_offset, header->title_count, sizeof(IR_Title)) &&
+           section_fits(header, header->smarttype_offset, header->smarttype_count, sizeof(IR_SmartType)) &&
+           section_fits(header, header->string_offset, header->string_bytes, 1) &&
+           section_fits(header, header->list_offset, list_count, sizeof(int32_t));
+}
+
+static int text_range_valid(IR_Header* header, int32_t first, int32_t count)
+{
+    return first >= 0 && count >= 0 && (uint32_t) first <= header->text_count &&
+           (uint32_t) count <= header->text_count - (uint32_t) first;
+}
+
+static int string_range_valid(IR_Header* header, int32_t offset, int32_t length)
+{
+    return offset >= 0 && length >= 0 && (uint32_t) offset <= header->string_bytes &&
+           (uint32_t) length <= header->string_bytes - (uint32_t) offset;
+}
+
+static Elem make_elem(IR_Elem* record, Text* texts)
+{
+    Elem e = { (Elem_Type) record->type, texts + record->first_text, record->text_count,
+               record->source_start, record->source_end };
+    return e;
+}
+
+static int fill_parser(Parser* parser, IR_Header* header, char* base)
+{
+    Span* spans = (Span*) (base + header->span_offset);
+    for (uint32_t i = 0; i < header->span_count; i++)
+    {
+        if (spans[i].offset < 0 || spans[i].length < 0 ||
+            spans[i].offset > parser->length - spans[i].length)
+            return 0;
+    }
+
+    // The only per-file allocations, one for all the texts and one for all the elements
+    IR_Text* text_records = (IR_Text*) (base + header->text_offset);
+    Text* texts = arena_push_array(parser->arena, Text, header->text_count ? header->text_count : 1);
+
+    for (uint32_t i = 0; i < header->text_count; i++)
+    {
+        IR_Text* record = text_records + i;
+        if (record->emphasis_flags < 0 || record->emphasis_flags > (EMPHASIS_ITALICIZED | EMPHASIS_BOLD | EMPHASIS_UNDERLINED) ||
+            record->first_span < 0 || record->span_count < 0 || (uint32_t) record->first_span > header->span_count ||
+            (uint32_t) record->span_count > header->span_count - (uint32_t) record->first_span)
+            return 0;
+
+        texts[i].emphasis_flags = record->emphasis_flags;
+        texts[i].spans          = spans + record->first_span;
+        texts[i].span_count     = record->span_count;
+    }
+
+    IR_Elem* elems = (IR_Elem*) (base + header->elem_offset);
+    da_resize(parser->elements, header->elem_count);
+    for (uint32_t i = 0; i < header->elem_count; i++)
+    {
+        if (elems[i].type < ELEM_TP_DETAIL || elems[i].type > ELEM_PAGE_BREAK ||
+            !text_range_valid(header, elems[i].first_text, elems[i].text_count))
+            return 0;
+
+        da_push_back(parser->elements, make_elem(elems + i, texts));
+    }
+
+    IR_Title* titles = (IR_Title*) (base + header->title_offset);
+    for (uint32_t i = 0; i < header->title_count; i++)
+    {
+        IR_Title* title = titles + i;
+        if (title->key_offset < 0 || title->key_length < 0 || title->key_offset > parser->length - title->key_length ||
+            !text_range_valid(header, title->elem.first_text, title->elem.text_count))
+            return 0;
+
+        map_put(parser->title_page_details, parser->content + title->key_offset, title->key_length,
+                make_elem(&title->elem, texts));
+    }
+
+    // Interning has to give every string the id it had when it was saved
+    IR_SmartType* records = (IR_SmartType*) (base + header->smarttype_offset);
+    char* strings = base + header->string_offset;
+    for (uint32_t i = 0; i < header->smarttype_count; i++)
+    {
+        IR_SmartType* record = records + i;
+        if (!string_range_valid(header, record->name_offset, record->name_length) ||
+            !string_range_valid(header, record->escaped_offset, record->escaped_length))
+            return 0;
+
+        int is_new;
+        int id = intern(&parser->interned, strings + record->name_offset, record->name_length, &is_new);
+        if (!is_new || id != (int) i)
+            return 0;
+
+        SmartType_String s = { strings + record->escaped_offset, record->escaped_length, record->lists };
+        da_push_back(parser->smarttype, s);
+    }
+
+    int32_t* ids = (int32_t*) (base + header->list_offset);
+    DArray(int)* lists[IR_LIST_COUNT];
+    parser_lists(parser, lists);
+
+    for (int l = 0; l < IR_LIST_COUNT; l++)
+    {
+        for (uint32_t i = 0; i < header->list_counts[l]; i++)
+        {
+            if (ids[i] < 0 || (uint32_t) ids[i] >= header->smarttype_count)
+                return 0;
+        }
+
+        da_append(*lists[l], ids, header->list_counts[l]);
+        ids += header->list_counts[l];
+    }
+
+    return 1;
+}
+
+int ir_load(IR_View* view, const char* filepath, Arena* arena)
+{
+    memset(view, 0, sizeof(*view));
+
+    if (!load_file(filepath, &view->file))
+        return 0;
+
+    IR_Header header;
+    if (view->file.size < sizeof(header))
+    {
+        unload_file(&view->file);
+        return 0;
+    }
+
+    // Mapped files are page aligned, but one that had to be read might not be
+    memcpy(&header, view->file.data, sizeof(header));
+    if (!header_valid(&header, view->file.size) || ((uintptr_t) view->file.data % IR_ALIGNMENT) != 0 ||
+        header.check_hash != ir_check_hash(view->file.data, header.file_size))
+    {
+        unload_file(&view->file);
+        return 0;
+    }
+
+    char* base = view->file.data;
+    view->parser = parser_make(base + header.content_offset, header.content_length, arena);
+    view->source_hash = header.source_hash;
+
+    if (!fill_parser(&view->parser, &header, base))
+    {
+        ir_unload(view);
+        return 0;
+    }
+
+    return 1;
+}
+
+void ir_unload(IR_View* view)
+{
+    if (view->parser.arena)
+        parser_free(&view->parser);
+
+    unload_file(&view->file);
+    memset(view, 0, sizeof(*view));
+}
\ No newline at end of file
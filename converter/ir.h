@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include "fountain.h"
+#include "filestuff.h"
+
+/*
+    Parsed screenplays on disk
+    A binary dump of everything parser_parse makes: the content, elements,
+    texts, spans, title page and SmartType tables. There are no pointers in
+    it, only offsets and indices, so it can be mapped anywhere.
+
+    Loading maps the file and points a parser at it. The content, spans and
+    escaped SmartType strings are used straight from the mapping, only the
+    elements and texts get their pointers filled in, into one array each.
+    The loaded parser works with anything that takes a parsed one, like
+    write_fdx, it just can't be parsed with again.
+
+    Files are only read by the converter that wrote them. A different
+    IR_VERSION, byte order or Span layout fails the load and the screenplay
+    has to be parsed again, and so does a file whose bytes don't match the
+    hash stored in it.
+*/
+
+#define IR_VERSION 3
+
+typedef struct _IR_View
+{
+    File_View file;
+    Parser parser;          // Points into file
+    uint64_t source_hash;   // ir_source_hash of the content it was parsed from
+} IR_View;
+
+uint64_t ir_source_hash(const char* content, size_t length);
+
+int  ir_save(Parser* parser, const char* filepath);    // The parser has to have been parsed
+int  ir_load(IR_View* view, const char* filepath, Arena* arena);  // 0 if it's missing, damaged or out of date
+void ir_unload(IR_View* view);
\ No newline at end of file
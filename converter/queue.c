@@ -0,0 +1,113 @@
+#include "queue.h"
+
+#include <stdlib.h>
+#include "threads.h"
+#include "containers/hd_assert.h"
+
+// Spins this many times before it starts sleeping
+#define QUEUE_SPIN_COUNT 64
+
+Queue queue_make(int capacity)
+{
+    int cap = 2;
+    while (cap < capacity)
+        cap *= 2;
+
+    Queue queue = { 0 };
+    queue.cells = (Queue_Cell*) malloc(sizeof(Queue_Cell) * cap);
+    hd_assert(queue.cells != NULL);
+    queue.mask = cap - 1;
+
+    for (int i = 0; i < cap; i++)
+        queue.cells[i].sequence = i;
+
+    return queue;
+}
+
+void queue_free(Queue* queue)
+{
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// A cell is free to push into at position pos when its sequence is pos, and
+// has something to pop at pos when it's pos + 1. Popping sets it to the
+// position it'll be pushed at next time around.
+int queue_push(Queue* queue, void* data)
+{
+    int pos = atomic_load_int(&queue->head);
+
+    while (1)
+    {
+        Queue_Cell* cell = queue->cells + (pos & queue->mask);
+        int diff = atomic_load_int(&cell->sequence) - pos;
+
+        if (diff == 0)
+        {
+            if (atomic_cas_int(&queue->head, pos, pos + 1))
+            {
+                cell->data = data;
+                atomic_store_int(&cell->sequence, pos + 1);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0;   // Full
+        }
+
+        pos = atomic_load_int(&queue->head);
+    }
+}
+
+int queue_pop(Queue* queue, void** data)
+{
+    int pos = atomic_load_int(&queue->tail);
+
+    while (1)
+    {
+        Queue_Cell* cell = queue->cells + (pos & queue->mask);
+        int diff = atomic_load_int(&cell->sequence) - (pos + 1);
+
+        if (diff == 0)
+        {
+            if (atomic_cas_int(&queue->tail, pos, pos + 1))
+            {
+                *data = cell->data;
+                atomic_store_int(&cell->sequence, pos + queue->mask + 1);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0;   // Empty
+        }
+
+        pos = atomic_load_int(&queue->tail);
+    }
+}
+
+static void queue_backoff(int* tries)
+{
+    if (++(*tries) < QUEUE_SPIN_COUNT)
+        thread_yield();
+    else
+        thread_sleep_ms(1);
+}
+
+void queue_push_wait(Queue* queue, void* data)
+{
+    int tries = 0;
+    while (!queue_push(queue, data))
+        queue_backoff(&tries);
+}
+
+void* queue_pop_wait(Queue* queue)
+{
+    void* data;
+    int tries = 0;
+    while (!queue_pop(queue, &data))
+        queue_backoff(&tries);
+
+    return data;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+// Bounded multi-producer multi-consumer queue of pointers, lock free. Every
+// cell has a sequence number that says whose turn it is, so producers and
+// consumers only ever race on a compare and swap of head or tail.
+// Based on Dmitry Vyukov's bounded MPMC queue.
+typedef struct _Queue_Cell
+{
+    int sequence;
+    void* data;
+} Queue_Cell;
+
+typedef struct _Queue
+{
+    Queue_Cell* cells;
+    int mask;           // Capacity - 1, capacity is a power of 2
+
+    int head;           // Next push
+    char pad[60];       // Keep producers and consumers off each other's cache line
+    int tail;           // Next pop
+} Queue;
+
+Queue queue_make(int capacity);     // Rounded up to a power of 2
+void  queue_free(Queue* queue);
+
+// Both return 0 right away if the queue is full or empty
+int queue_push(Queue* queue, void* data);
+int queue_pop(Queue* queue, void** data);
+
+// Wait till there's room or something to take, this is where backpressure comes from
+void  queue_push_wait(Queue* queue, void* data);
+void* queue_pop_wait(Queue* queue);
\ No newline at end of file
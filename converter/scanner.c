@@ -0,0 +1,277 @@
+#include "scanner.h"
+
+#include <string.h>
+#include "threads.h"
+
+// The SIMD versions need SSE2 without a runtime check, like hash_map.h. Every
+// x86-64 build has it, 32-bit x86 built without it gets the scalar version.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCANNER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Every build only has what get_scan_impl can pick
+#if !defined(SCANNER_X86) || defined(SCANNER_NO_SIMD)
+
+enum
+{
+    CLASS_NEWLINE    = 0x01,
+    CLASS_NON_WS     = 0x02,
+    CLASS_LOWER      = 0x04,
+    CLASS_STRUCTURAL = 0x08,
+};
+
+static unsigned char char_classes[256];
+static int classes_ready = 0;
+
+static void init_char_classes(void)
+{
+    for (int ch = 0; ch < 256; ch++)
+    {
+        unsigned char c = 0;
+
+        if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n')
+            c |= CLASS_NON_WS;
+
+        if (ch >= 'a' && ch <= 'z')
+            c |= CLASS_LOWER;
+
+        char_classes[ch] = c;
+    }
+
+    char_classes['\n'] |= CLASS_NEWLINE;
+
+    const char structural[] = "\t\r*_()><=/!@:";
+    for (int i = 0; structural[i]; i++)
+        char_classes[(unsigned char) structural[i]] |= CLASS_STRUCTURAL;
+
+    classes_ready = 1;
+}
+
+static void scan_block_scalar(const char* block, Scan_Masks* masks)
+{
+    if (!classes_ready)
+        init_char_classes();
+
+    uint64_t newline = 0, non_ws = 0, lower = 0, structural = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i++)
+    {
+        unsigned char c = char_classes[(unsigned char) block[i]];
+        uint64_t bit = 1ULL << i;
+
+        if (c & CLASS_NEWLINE)    newline    |= bit;
+        if (c & CLASS_NON_WS)     non_ws     |= bit;
+        if (c & CLASS_LOWER)      lower      |= bit;
+        if (c & CLASS_STRUCTURAL) structural |= bit;
+    }
+
+    masks->newline    = newline;
+    masks->non_ws     = non_ws;
+    masks->lower      = lower;
+    masks->structural = structural;
+}
+
+#else
+
+static void scan_block_sse2(const char* block, Scan_Masks* masks)
+{
+    const __m128i nl    = _mm_set1_epi8('\n');
+    const __m128i cr    = _mm_set1_epi8('\r');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    const __m128i space = _mm_set1_epi8(' ');
+
+    // Shifts 'a'..'z' to the bottom of the signed range so one compare does it
+    const __m128i lower_shift = _mm_set1_epi8((char) (0x80 - 'a'));
+    const __m128i lower_limit = _mm_set1_epi8(-128 + 26);
+
+    uint64_t newline = 0, non_ws = 0, lower = 0, structural = 0;
+
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) (block + i));
+
+        __m128i is_nl  = _mm_cmpeq_epi8(v, nl);
+        __m128i is_cr  = _mm_cmpeq_epi8(v, cr);
+        __m128i is_tab = _mm_cmpeq_epi8(v, tab);
+        __m128i is_ws  = _mm_or_si128(_mm_or_si128(is_nl, is_cr),
+                                      _mm_or_si128(is_tab, _mm_cmpeq_epi8(v, space)));
+
+        __m128i is_lower = _mm_cmplt_epi8(_mm_add_epi8(v, lower_shift), lower_limit);
+
+        __m128i s = _mm_or_si128(is_cr, is_tab);
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('!')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('@')));
+        s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+
+        newline    |= (uint64_t) (unsigned) _mm_movemask_epi8(is_nl)    << i;
+        non_ws     |= (uint64_t) (unsigned) (~_mm_movemask_epi8(is_ws) & 0xFFFF) << i;
+        lower      |= (uint64_t) (unsigned) _mm_movemask_epi8(is_lower) << i;
+        structural |= (uint64_t) (unsigned) _mm_movemask_epi8(s)        << i;
+    }
+
+    masks->newline    = newline;
+    masks->non_ws     = non_ws;
+    masks->lower      = lower;
+    masks->structural = structural;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+TARGET_AVX2
+static void scan_block_avx2(const char* block, Scan_Masks* masks)
+{
+    // Structural chars are matched with a nibble lookup: every high nibble
+    // that has structural chars gets a bit, and the low nibble table holds
+    // the bits of the high nibbles it forms a structural char with.
+    //   0x0_: \t \r        -> 0x01
+    //   0x2_: ! ( ) * /    -> 0x02
+    //   0x3_: : < = >      -> 0x04
+    //   0x4_: @            -> 0x08
+    //   0x5_: _            -> 0x10
+    const __m256i high_table = _mm256_setr_epi8(
+        0x01, 0, 0x02, 0x04, 0x08, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x01, 0, 0x02, 0x04, 0x08, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    const __m256i low_table = _mm256_setr_epi8(
+        0x08, 0x02, 0, 0, 0, 0, 0, 0, 0x02, 0x03, 0x06, 0, 0x04, 0x05, 0x04, 0x12,
+        0x08, 0x02, 0, 0, 0, 0, 0, 0, 0x02, 0x03, 0x06, 0, 0x04, 0x05, 0x04, 0x12);
+
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i nl     = _mm256_set1_epi8('\n');
+    const __m256i cr     = _mm256_set1_epi8('\r');
+    const __m256i tab    = _mm256_set1_epi8('\t');
+    const __m256i space  = _mm256_set1_epi8(' ');
+
+    const __m256i lower_shift = _mm256_set1_epi8((char) (0x80 - 'a'));
+    const __m256i lower_limit = _mm256_set1_epi8(-128 + 26);
+
+    uint64_t newline = 0, non_ws = 0, lower = 0, structural = 0;
+
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (block + i));
+
+        __m256i is_nl = _mm256_cmpeq_epi8(v, nl);
+        __m256i is_ws = _mm256_or_si256(_mm256_or_si256(is_nl, _mm256_cmpeq_epi8(v, cr)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(v, tab), _mm256_cmpeq_epi8(v, space)));
+
+        __m256i is_lower = _mm256_cmpgt_epi8(lower_limit, _mm256_add_epi8(v, lower_shift));
+
+        // Bytes >= 0x80 have a high nibble with no bits so they never match
+        __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i low  = _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble));
+        __m256i s    = _mm256_cmpeq_epi8(_mm256_and_si256(high, low), _mm256_setzero_si256());
+
+        newline    |= (uint64_t) (unsigned) _mm256_movemask_epi8(is_nl)    << i;
+        non_ws     |= (uint64_t) (unsigned) ~_mm256_movemask_epi8(is_ws)   << i;
+        lower      |= (uint64_t) (unsigned) _mm256_movemask_epi8(is_lower) << i;
+        structural |= (uint64_t) (unsigned) ~_mm256_movemask_epi8(s)       << i;
+    }
+
+    masks->newline    = newline;
+    masks->non_ws     = non_ws;
+    masks->lower      = lower;
+    masks->structural = structural;
+}
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+
+    // AVX2 needs the OS to save the ymm registers too
+    __cpuid(info, 1);
+    int osxsave = (info[2] & (1 << 27)) != 0;
+    int avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return 0;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+typedef void (*Scan_Proc)(const char* block, Scan_Masks* masks);
+
+typedef struct _Scan_Impl
+{
+    Scan_Proc proc;
+    const char* name;
+} Scan_Impl;
+
+#if defined(SCANNER_X86) && !defined(SCANNER_NO_SIMD)
+static const Scan_Impl scan_avx2 = { scan_block_avx2, "avx2" };
+static const Scan_Impl scan_sse2 = { scan_block_sse2, "sse2" };
+#else
+static const Scan_Impl scan_scalar = { scan_block_scalar, "scalar" };
+#endif
+
+// Picked on first use. Threads can race to pick it but they all pick the same one.
+static const Scan_Impl* scan_impl = NULL;
+
+static const Scan_Impl* get_scan_impl(void)
+{
+    const Scan_Impl* impl = (const Scan_Impl*) atomic_load_ptr(&scan_impl);
+    if (impl)
+        return impl;
+
+#if defined(SCANNER_X86) && !defined(SCANNER_NO_SIMD)
+    impl = cpu_has_avx2() ? &scan_avx2 : &scan_sse2;
+#else
+    impl = &scan_scalar;
+#endif
+
+    atomic_store_ptr(&scan_impl, impl);
+    return impl;
+}
+
+void scan_block(const char* block, size_t len, Scan_Masks* masks)
+{
+    Scan_Proc scan_proc = get_scan_impl()->proc;
+
+    if (len >= SCAN_BLOCK_SIZE)
+    {
+        scan_proc(block, masks);
+        return;
+    }
+
+    // Pad the tail, the padding is masked off below
+    char padded[SCAN_BLOCK_SIZE];
+    memset(padded, ' ', sizeof(padded));
+    memcpy(padded, block, len);
+    scan_proc(padded, masks);
+
+    uint64_t valid = scan_bits_below((int) len);
+    masks->newline    &= valid;
+    masks->non_ws     &= valid;
+    masks->lower      &= valid;
+    masks->structural &= valid;
+}
+
+const char* scanner_impl_name(void)
+{
+    return get_scan_impl()->name;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stage 1 of parsing: classifies the input 64 bytes at a time with SIMD
+// (AVX2 or SSE2, picked at runtime) so the parser only has to look at the
+// bytes that matter instead of branching on every char.
+//
+// The SIMD paths can be turned off with:
+//     #define SCANNER_NO_SIMD
+
+#define SCAN_BLOCK_SIZE 64
+
+// Bit i is set if block[i] belongs to the class
+typedef struct _Scan_Masks
+{
+    uint64_t newline;       // '\n'
+    uint64_t non_ws;        // Anything but ' ', '\t', '\r' and '\n'
+    uint64_t lower;         // 'a' to 'z'
+    uint64_t structural;    // '\t' '\r' '*' '_' '(' ')' '>' '<' '/' '=' '!' '@' ':'
+} Scan_Masks;
+
+// len can be less than SCAN_BLOCK_SIZE for the last block, bits past len are 0
+void scan_block(const char* block, size_t len, Scan_Masks* masks);
+
+// Name of the implementation in use, for diagnostics
+const char* scanner_impl_name(void);
+
+static inline int scan_first_bit(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int) index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static inline int scan_last_bit(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return (int) index;
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+}
+
+// Bits [from, 64), from can be 64
+static inline uint64_t scan_bits_from(int from)
+{
+    return (from >= 64) ? 0 : (~0ULL << from);
+}
+
+// Bits [0, to), to can be 64
+static inline uint64_t scan_bits_below(int to)
+{
+    return (to >= 64) ? ~0ULL : ((1ULL << to) - 1);
+}
\ No newline at end of file
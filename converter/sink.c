@@ -0,0 +1,426 @@
+#include "sink.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#include "stats.h"
+
+#define STRING_BUILDER_IMPL
+#include "containers/string_builder.h"
+
+static Sink sink_make(Sink_Type type)
+{
+    Sink sink = { 0 };
+    sink.type = type;
+    sink.fd   = -1;
+    sink.buffer = sb_make((type == SINK_MEMORY || type == SINK_FIXED) ? 0 : SINK_BUFFER_SIZE);
+    return sink;
+}
+
+Sink sink_make_fd(int fd)
+{
+    Sink sink = sink_make(SINK_FD);
+    sink.fd = fd;
+    return sink;
+}
+
+Sink sink_make_fd_at(int fd, long long offset)
+{
+    Sink sink = sink_make(SINK_FD_AT);
+    sink.fd = fd;
+    sink.offset = offset;
+    return sink;
+}
+
+static int open_for_writing(const char* filepath)
+{
+#ifdef _WIN32
+    return _open(filepath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+int sink_open_file(Sink* sink, const char* filepath)
+{
+    int fd = open_for_writing(filepath);
+    if (fd < 0)
+        return 0;
+
+    *sink = sink_make_fd(fd);
+    sink->owns_fd = 1;
+    return 1;
+}
+
+int sink_reopen_file(Sink* sink, const char* filepath)
+{
+    sink_close_file(sink);
+
+    sb_clear(&sink->buffer);
+    sink->failed = 0;
+    sink->offset = 0;
+
+    int fd = open_for_writing(filepath);
+    if (fd < 0)
+        return 0;
+
+    sink->type    = SINK_FD;
+    sink->fd      = fd;
+    sink->owns_fd = 1;
+    return 1;
+}
+
+int sink_open_file_gather(Sink* sink, const char* filepath)
+{
+    int fd = open_for_writing(filepath);
+    if (fd < 0)
+        return 0;
+
+    *sink = sink_make(SINK_FD_GATHER);
+    sink->fd = fd;
+    sink->owns_fd = 1;
+
+    sink->pieces = (Sink_Piece*) malloc(SINK_GATHER_PIECES * sizeof(Sink_Piece));
+    hd_assert(sink->pieces != NULL);
+    return 1;
+}
+
+Sink sink_make_fixed(char* data, size_t size)
+{
+    Sink sink = sink_make(SINK_FIXED);
+    sink.fixed      = data;
+    sink.fixed_size = size;
+    return sink;
+}
+
+Sink sink_make_memory(void)
+{
+    return sink_make(SINK_MEMORY);
+}
+
+Sink sink_make_callback(Sink_Callback callback, void* user)
+{
+    Sink sink = sink_make(SINK_CALLBACK);
+    sink.callback = callback;
+    sink.user     = user;
+    return sink;
+}
+
+static int write_all(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+#ifdef _WIN32
+        unsigned int chunk = (size > 0x40000000) ? 0x40000000 : (unsigned int) size;
+        int written = _write(fd, data, chunk);
+        if (written <= 0)
+            return 0;
+#else
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return 0;
+        }
+#endif
+        data += written;
+        size -= (size_t) written;
+    }
+
+    return 1;
+}
+
+static int write_all_at(int fd, const char* data, size_t size, long long offset)
+{
+#ifdef _WIN32
+    HANDLE file = (HANDLE) _get_osfhandle(fd);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+#endif
+
+    while (size > 0)
+    {
+#ifdef _WIN32
+        DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD) size;
+        DWORD written = 0;
+
+        OVERLAPPED overlapped = { 0 };
+        overlapped.Offset     = (DWORD) offset;
+        overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+        if (!WriteFile(file, data, chunk, &written, &overlapped) || written == 0)
+            return 0;
+#else
+        ssize_t written = pwrite(fd, data, size, (off_t) offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return 0;
+        }
+#endif
+        data   += written;
+        size   -= (size_t) written;
+        offset += written;
+    }
+
+    return 1;
+}
+
+static int write_all_pieces(int fd, Sink_Piece* pieces, int count)
+{
+#ifdef _WIN32
+    // WriteFileGather only takes whole pages, the pieces are written one by one
+    for (int i = 0; i < count; i++)
+    {
+        if (!write_all(fd, pieces[i].data, pieces[i].size))
+            return 0;
+    }
+#else
+    struct iovec iov[SINK_GATHER_PIECES];
+    for (int i = 0; i < count; i++)
+    {
+        iov[i].iov_base = (void*) pieces[i].data;
+        iov[i].iov_len  = pieces[i].size;
+    }
+
+    int first = 0;
+    while (first < count)
+    {
+        ssize_t written = writev(fd, iov + first, count - first);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return 0;
+        }
+
+        // Short writes can stop in the middle of a piece
+        while (first < count && (size_t) written >= iov[first].iov_len)
+            written -= iov[first++].iov_len;
+
+        if (first < count)
+        {
+            iov[first].iov_base = (char*) iov[first].iov_base + written;
+            iov[first].iov_len -= (size_t) written;
+        }
+    }
+#endif
+
+    return 1;
+}
+
+// What's been buffered since the last piece becomes one. There's always
+// room for it, a gathering sink flushes before its pieces run out.
+static void gather_buffered(Sink* sink)
+{
+    size_t size = sink->buffer.length - sink->buffer_taken;
+    if (size == 0)
+        return;
+
+    Sink_Piece piece = { sink->buffer.data + sink->buffer_taken, size };
+    sink->pieces[sink->piece_count++] = piece;
+    sink->buffer_taken = sink->buffer.length;
+}
+
+static void sink_flush_pieces(Sink* sink)
+{
+    gather_buffered(sink);
+
+    size_t size = 0;
+    for (int i = 0; i < sink->piece_count; i++)
+        size += sink->pieces[i].size;
+
+    stats_start(timer);
+    if (!sink->failed && !write_all_pieces(sink->fd, sink->pieces, sink->piece_count))
+        sink->failed = 1;
+    stats_stop(timer, STATS_WRITE);
+
+    sink->offset += size;
+    sink->piece_count  = 0;
+    sink->buffer_taken = 0;
+    sb_clear(&sink->buffer);
+}
+
+// Hands data straight to the fd or callback
+static void sink_emit(Sink* sink, const char* data, size_t size)
+{
+    if (sink->failed || size == 0)
+        return;
+
+    int ok = 1;
+    switch (sink->type)
+    {
+        case SINK_FD_AT:    ok = write_all_at(sink->fd, data, size, sink->offset); break;
+        case SINK_CALLBACK: ok = sink->callback(sink->user, data, size); break;
+        case SINK_MEMORY:   break;
+
+        case SINK_FD:
+        {
+            stats_start(timer);
+            ok = write_all(sink->fd, data, size);
+            stats_stop(timer, STATS_WRITE);
+        } break;
+
+        case SINK_FIXED:
+        {
+            ok = sink->offset + size <= sink->fixed_size;
+            if (ok)
+                memcpy(sink->fixed + sink->offset, data, size);
+        } break;
+
+        // Only ever flushed whole, by sink_flush_pieces
+        case SINK_FD_GATHER: break;
+    }
+
+    if (!ok)
+        sink->failed = 1;
+
+    sink->offset += size;
+}
+
+int sink_flush(Sink* sink)
+{
+    if (sink->type == SINK_FD_GATHER)
+    {
+        sink_flush_pieces(sink);
+    }
+    else if (sink->type != SINK_MEMORY)
+    {
+        sink_emit(sink, sink->buffer.data, sink->buffer.length);
+        sb_clear(&sink->buffer);
+    }
+
+    return !sink->failed;
+}
+
+void sink_write(Sink* sink, const char* data, size_t size)
+{
+    if (sink->type == SINK_FIXED)
+    {
+        sink_emit(sink, data, size);
+        return;
+    }
+
+    if (sink->type == SINK_FD_GATHER && size >= SINK_GATHER_MIN)
+    {
+        // Room for this one and whatever's buffered before it
+        if (sink->piece_count + 2 >= SINK_GATHER_PIECES)
+            sink_flush(sink);
+
+        gather_buffered(sink);
+
+        Sink_Piece piece = { data, size };
+        sink->pieces[sink->piece_count++] = piece;
+        return;
+    }
+
+    if (sink->type != SINK_MEMORY && sink->buffer.length + size > SINK_BUFFER_SIZE)
+    {
+        sink_flush(sink);
+
+        // Too big to be worth buffering
+        if (size >= SINK_BUFFER_SIZE)
+        {
+            sink_emit(sink, data, size);
+            return;
+        }
+    }
+
+    sb_append_n(&sink->buffer, data, size);
+}
+
+char* sink_reserve(Sink* sink, size_t size)
+{
+    if (sink->type == SINK_FIXED)
+    {
+        if (!sink->failed && sink->offset + size <= sink->fixed_size)
+        {
+            char* at = sink->fixed + sink->offset;
+            sink->offset += size;
+            return at;
+        }
+
+        // It still needs somewhere to go
+        sink->failed = 1;
+        sb_clear(&sink->buffer);
+        sb_reserve(&sink->buffer, size);
+        return sink->buffer.data;
+    }
+
+    if (sink->type != SINK_MEMORY && sink->buffer.length + size > SINK_BUFFER_SIZE)
+        sink_flush(sink);
+
+    sb_reserve(&sink->buffer, size);
+    char* at = sink->buffer.data + sink->buffer.length;
+
+    sink->buffer.length += size;
+    sink->buffer.data[sink->buffer.length] = '\0';
+    return at;
+}
+
+void sink_write_str(Sink* sink, const char* str)
+{
+    sink_write(sink, str, strlen(str));
+}
+
+void sink_write_fmt(Sink* sink, const char* fmt, ...)
+{
+    // Growing the buffer would move what the pieces point to
+    if (sink->type == SINK_FD_GATHER)
+        sink_flush(sink);
+
+    va_list args;
+    va_start(args, fmt);
+    sb_append_fmtv(&sink->buffer, fmt, args);
+    va_end(args);
+
+    if (sink->type == SINK_FIXED || (sink->type != SINK_MEMORY && sink->buffer.length >= SINK_BUFFER_SIZE))
+        sink_flush(sink);
+}
+
+int sink_close_file(Sink* sink)
+{
+    int ok = sink_flush(sink);
+
+    if (sink->owns_fd)
+    {
+#ifdef _WIN32
+        ok = (_close(sink->fd) == 0) && ok;
+#else
+        ok = (close(sink->fd) == 0) && ok;
+#endif
+    }
+
+    sink->fd = -1;
+    sink->owns_fd = 0;
+    return ok;
+}
+
+int sink_close(Sink* sink)
+{
+    int ok = sink_close_file(sink);
+    sb_free(&sink->buffer);
+
+    free(sink->pieces);
+    sink->pieces = NULL;
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include "containers/string_builder.h"
+
+#define SINK_BUFFER_SIZE (64 * 1024)
+
+// Gathering sinks only take writes this big or bigger as they are, smaller
+// ones are copied together into the buffer
+#ifndef SINK_GATHER_MIN
+#define SINK_GATHER_MIN 256
+#endif
+
+#define SINK_GATHER_PIECES 64
+
+// Returns 0 if the data couldn't be taken
+typedef int (*Sink_Callback)(void* user, const char* data, size_t size);
+
+typedef enum _Sink_Type
+{
+    SINK_FD,
+    SINK_FD_AT,     // Writes at offset and moves it, the fd's own position isn't used
+    SINK_MEMORY,
+    SINK_CALLBACK,
+    SINK_FIXED,     // Straight into memory that's already there, like a mapped file, never past its end
+    SINK_FD_GATHER, // Big writes aren't copied, they're handed to the fd in place with writev
+} Sink_Type;
+
+typedef struct _Sink_Piece
+{
+    const char* data;
+    size_t size;
+} Sink_Piece;
+
+// Where generated output goes. Writes are collected in buffer and handed to
+// the fd or callback once SINK_BUFFER_SIZE is reached. Memory sinks never
+// flush, buffer ends up holding all of the output.
+typedef struct _Sink
+{
+    Sink_Type type;
+    String_Builder buffer;
+
+    int fd;
+    int owns_fd;
+    long long offset;   // Bytes flushed so far, where the next flush goes for SINK_FD_AT
+
+    Sink_Callback callback;
+    void* user;
+
+    char*  fixed;
+    size_t fixed_size;
+
+    Sink_Piece* pieces;     // Waiting for the next flush, in order
+    int piece_count;
+    size_t buffer_taken;    // The buffer up to here is in pieces already
+
+    int failed;     // Set once a flush fails, later writes are dropped
+} Sink;
+
+Sink sink_make_fd(int fd);
+Sink sink_make_fd_at(int fd, long long offset);     // Any number of these can write to one fd at once
+int  sink_open_file(Sink* sink, const char* filepath);
+Sink sink_make_memory(void);
+Sink sink_make_callback(Sink_Callback callback, void* user);
+Sink sink_make_fixed(char* data, size_t size);
+
+// Everything given to sink_write has to stay where it is till the sink is
+// flushed, only what goes into the buffer is copied
+int  sink_open_file_gather(Sink* sink, const char* filepath);
+
+void sink_write(Sink* sink, const char* data, size_t size);
+void sink_write_str(Sink* sink, const char* str);
+void sink_write_fmt(Sink* sink, const char* fmt, ...);
+
+// Room for size more bytes of output, to be filled in before the sink is
+// used again. Saves a copy when the bytes are made right where they go.
+char* sink_reserve(Sink* sink, size_t size);
+
+// Both return 0 if anything failed to be written. sink_close also closes the
+// fd if the sink opened it and frees the buffer, so read a memory sink's
+// buffer before closing it.
+int sink_flush(Sink* sink);
+int sink_close(Sink* sink);
+
+// For writing many files one after the other through the same buffer.
+// sink_close_file flushes and closes the file but keeps the sink usable,
+// sink_reopen_file points it at the next one.
+int sink_reopen_file(Sink* sink, const char* filepath);
+int sink_close_file(Sink* sink);
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "stats.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define ALLOC_COUNT_IMPL
+#include "containers/alloc_count.h"
+
+Stats stats;
+
+static const char* phase_names[STATS_PHASE_COUNT] = {
+    "load", "title_page", "screenplay", "smarttype", "fdx_size",
+    "fdx_elements", "fdx_title_page", "fdx_smarttype", "fdx_end", "write",
+};
+
+static const char* elem_names[STATS_ELEM_TYPES] = {
+    "title_page_detail", "scene_heading", "action", "character", "dialogue",
+    "parenthetical", "transition", "centered_text", "boneyard", "page_break",
+};
+
+int stats_enable(void)
+{
+#ifdef FF_NO_STATS
+    return 0;
+#else
+    stats.enabled = 1;
+    container_allocs.counting = 1;
+    return 1;
+#endif
+}
+
+void stats_timer_start(Stats_Timer* timer)
+{
+    timer->start  = wall_clock();
+    timer->nested = stats.nested;
+}
+
+void stats_timer_stop(Stats_Timer* timer, Stats_Phase phase)
+{
+    double spent = wall_clock() - timer->start;
+
+    stats.seconds[phase] += spent - (stats.nested - timer->nested);
+    stats.nested = timer->nested + spent;
+}
+
+// In bytes, 0 if the OS won't say
+static long long peak_rss(void)
+{
+#ifdef _WIN32
+    // K32 is in kernel32 itself, psapi.lib doesn't have to be linked
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return (long long) counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return (long long) usage.ru_maxrss;
+#else
+    return (long long) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void print_text(FILE* file, long long rss)
+{
+    double total = 0;
+    for (int p = 0; p < STATS_PHASE_COUNT; p++)
+        total += stats.seconds[p];
+
+    fprintf(file, "%-20s %10s %6s\n", "phase", "ms", "%");
+    for (int p = 0; p < STATS_PHASE_COUNT; p++)
+    {
+        if (stats.seconds[p] == 0)
+            continue;
+
+        double share = (total > 0) ? 100 * stats.seconds[p] / total : 0;
+        fprintf(file, "%-20s %10.3f %6.1f\n", phase_names[p], stats.seconds[p] * 1000, share);
+    }
+    fprintf(file, "%-20s %10.3f\n\n", "total", total * 1000);
+
+    int elements = 0;
+    for (int t = 0; t < STATS_ELEM_TYPES; t++)
+    {
+        if (stats.elements[t] > 0)
+            fprintf(file, "%-20s %10d\n", elem_names[t], stats.elements[t]);
+
+        elements += stats.elements[t];
+    }
+    fprintf(file, "%-20s %10d\n\n", "elements", elements);
+
+    fprintf(file, "%-20s %10d\n", "text runs", stats.text_runs);
+    fprintf(file, "%-20s %10d\n", "emphasis toggles", stats.emphasis_toggles);
+    fprintf(file, "%-20s %10lld\n", "bytes in", stats.bytes_in);
+    fprintf(file, "%-20s %10lld\n", "bytes out", stats.bytes_out);
+    fprintf(file, "%-20s %10lld\n", "container allocs", container_allocs.calls);
+    fprintf(file, "%-20s %10lld\n", "container bytes", container_allocs.bytes);
+    fprintf(file, "%-20s %10.2f MB\n", "peak rss", rss / (1024.0 * 1024.0));
+}
+
+static void print_json(FILE* file, long long rss)
+{
+    fprintf(file, "{\"phases_ms\":{");
+    for (int p = 0; p < STATS_PHASE_COUNT; p++)
+        fprintf(file, "%s\"%s\":%.3f", p ? "," : "", phase_names[p], stats.seconds[p] * 1000);
+
+    fprintf(file, "},\"elements\":{");
+    for (int t = 0; t < STATS_ELEM_TYPES; t++)
+        fprintf(file, "%s\"%s\":%d", t ? "," : "", elem_names[t], stats.elements[t]);
+
+    fprintf(file, "},\"text_runs\":%d,\"emphasis_toggles\":%d", stats.text_runs, stats.emphasis_toggles);
+    fprintf(file, ",\"bytes_in\":%lld,\"bytes_out\":%lld", stats.bytes_in, stats.bytes_out);
+    fprintf(file, ",\"container_allocs\":%lld,\"container_alloc_bytes\":%lld", container_allocs.calls, container_allocs.bytes);
+    fprintf(file, ",\"peak_rss_bytes\":%lld}\n", rss);
+}
+
+void stats_print(FILE* file, Stats_Format format)
+{
+    long long rss = peak_rss();
+
+    if (format == STATS_JSON)
+        print_json(file, rss);
+    else
+        print_text(file, rss);
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdio.h>
+#include "fountain.h"
+#include "threads.h"
+
+// Where a conversion's time and memory go, for --stats. Nothing is measured
+// till stats_enable is called, till then every stats_ macro is one branch.
+// Building with FF_NO_STATS compiles them all out, CONTAINER_NO_ALLOC_COUNT
+// does the same for the container allocation counts.
+
+typedef enum _Stats_Phase
+{
+    STATS_LOAD,             // Reading the input, or the saved parse
+    STATS_TITLE_PAGE,
+    STATS_SCREENPLAY,
+    STATS_SMARTTYPE,
+    STATS_FDX_SIZE,         // Only when the output is sized before it's written
+    STATS_FDX_ELEMENTS,
+    STATS_FDX_TITLE_PAGE,
+    STATS_FDX_SMARTTYPE,
+    STATS_FDX_END,          // The fixed parts after the elements
+    STATS_WRITE,            // Handing the output to the OS
+    STATS_PHASE_COUNT,
+} Stats_Phase;
+
+#define STATS_ELEM_TYPES (ELEM_PAGE_BREAK + 1)
+
+typedef struct _Stats_Timer
+{
+    double start;
+    double nested;
+} Stats_Timer;
+
+// Phases run inside each other, streaming writes elements while it parses and
+// every part of the output is written while it's made. A phase's time only
+// counts what didn't go to the phases inside it, so they add up to the total.
+// Only the main thread times anything, the counters can be bumped from any.
+typedef struct _Stats
+{
+    int enabled;
+    double seconds[STATS_PHASE_COUNT];
+    double nested;      // Time the phases that are running have spent in the ones inside them
+
+    int elements[STATS_ELEM_TYPES];     // Written, by Elem_Type
+    int text_runs;
+    int emphasis_toggles;               // Times the emphasis changes from one text to the next
+
+    long long bytes_in;
+    long long bytes_out;
+} Stats;
+
+typedef enum _Stats_Format
+{
+    STATS_TEXT,
+    STATS_JSON,
+} Stats_Format;
+
+extern Stats stats;
+
+// Returns 0 if they were compiled out
+int  stats_enable(void);
+void stats_print(FILE* file, Stats_Format format);
+
+void stats_timer_start(Stats_Timer* timer);
+void stats_timer_stop(Stats_Timer* timer, Stats_Phase phase);
+
+#ifndef FF_NO_STATS
+#define stats_start(timer)          Stats_Timer timer = { 0 }; if (stats.enabled) stats_timer_start(&timer)
+#define stats_stop(timer, phase)    do { if (stats.enabled) stats_timer_stop(&timer, phase); } while (0)
+#define stats_count(counter, n)     do { if (stats.enabled) atomic_fetch_add_int(&stats.counter, (n)); } while (0)
+#define stats_add(counter, n)       do { if (stats.enabled) stats.counter += (n); } while (0)    // Main thread only
+#else
+#define stats_start(timer)          ((void) 0)
+#define stats_stop(timer, phase)    ((void) 0)
+#define stats_count(counter, n)     ((void) 0)
+#define stats_add(counter, n)       ((void) 0)
+#endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "threads.h"
+
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#else
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define THREADS_MAX 256
+
+#ifdef _WIN32
+
+static unsigned __stdcall thread_main(void* arg)
+{
+    Thread* thread = (Thread*) arg;
+    thread->proc(thread->user);
+    return 0;
+}
+
+int thread_start(Thread* thread, Thread_Proc proc, void* user)
+{
+    thread->proc = proc;
+    thread->user = user;
+    thread->handle = (void*) _beginthreadex(NULL, 0, thread_main, thread, 0, NULL);
+    return thread->handle != NULL;
+}
+
+void thread_join(Thread* thread)
+{
+    WaitForSingleObject((HANDLE) thread->handle, INFINITE);
+    CloseHandle((HANDLE) thread->handle);
+}
+
+int thread_hardware_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+}
+
+void thread_yield(void)
+{
+    SwitchToThread();
+}
+
+void thread_sleep_ms(int ms)
+{
+    Sleep(ms);
+}
+
+double wall_clock(void)
+{
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+}
+
+#else
+
+static void* thread_main(void* arg)
+{
+    Thread* thread = (Thread*) arg;
+    thread->proc(thread->user);
+    return NULL;
+}
+
+int thread_start(Thread* thread, Thread_Proc proc, void* user)
+{
+    thread->proc = proc;
+    thread->user = user;
+    return pthread_create(&thread->handle, NULL, thread_main, thread) == 0;
+}
+
+void thread_join(Thread* thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+int thread_hardware_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+}
+
+void thread_yield(void)
+{
+    sched_yield();
+}
+
+void thread_sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+double wall_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif
+
+void threads_run(int count, Thread_Proc proc, void* user)
+{
+    if (count > THREADS_MAX)
+        count = THREADS_MAX;
+
+    Thread threads[THREADS_MAX];
+    int started = 0;
+
+    for (int i = 1; i < count; i++)
+    {
+        if (!thread_start(&threads[started], proc, user))
+            break;
+
+        started++;
+    }
+
+    proc(user);
+
+    for (int i = 0; i < started; i++)
+        thread_join(&threads[i]);
+}
\ No newline at end of file
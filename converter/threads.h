@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+typedef void (*Thread_Proc)(void* user);
+
+// Has to stay where it is till it's joined, the new thread reads proc and user from it
+typedef struct _Thread
+{
+#ifdef _WIN32
+    void* handle;
+#else
+    pthread_t handle;
+#endif
+    Thread_Proc proc;
+    void* user;
+} Thread;
+
+int  thread_start(Thread* thread, Thread_Proc proc, void* user);   // 0 if it couldn't be started
+void thread_join(Thread* thread);
+
+int  thread_hardware_count(void);
+void thread_yield(void);
+void thread_sleep_ms(int ms);
+
+double wall_clock(void);    // Seconds since some fixed point, only good for differences
+
+// Runs proc on count threads, one of them the calling one, and waits for all
+// of them. The procs should pull their work from a shared counter, if some
+// threads can't be started the rest still get through all of it.
+void threads_run(int count, Thread_Proc proc, void* user);
+
+// atomic_fetch_add_int returns the value before the add, atomic_cas_int
+// returns 1 if *ptr was expected and is now desired
+#ifdef _WIN32
+#include <intrin.h>
+#define atomic_fetch_add_int(ptr, value) _InterlockedExchangeAdd((volatile long*) (ptr), (value))
+#define atomic_cas_int(ptr, expected, desired) \
+    (_InterlockedCompareExchange((volatile long*) (ptr), (desired), (expected)) == (long) (expected))
+#define atomic_load_int(ptr)             _InterlockedOr((volatile long*) (ptr), 0)
+#define atomic_store_int(ptr, value)     _InterlockedExchange((volatile long*) (ptr), (value))
+#define atomic_load_ptr(ptr)             (*(void* volatile*) (ptr))
+#define atomic_store_ptr(ptr, value)     (*(void* volatile*) (ptr) = (void*) (value))
+#else
+#define atomic_fetch_add_int(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_SEQ_CST)
+#define atomic_load_int(ptr)             __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define atomic_store_int(ptr, value)     __atomic_store_n((ptr), (value), __ATOMIC_SEQ_CST)
+#define atomic_load_ptr(ptr)             __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define atomic_store_ptr(ptr, value)     __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+static inline int atomic_cas_int(int* ptr, int expected, int desired)
+{
+    return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,531 @@
+#include "watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "filestuff.h"
+#include "fdx.h"
+#include "helpers.h"
+#include "threads.h"
+#include "containers/hash.h"
+#include "containers/hd_assert.h"
+
+#ifdef __linux__
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+#endif
+
+Watch watch_make(void)
+{
+    Watch watch = { 0 };
+    da_make(watch.files);
+    da_make(watch.dirs);
+    watch.rendered = sink_make_memory();
+
+#ifdef __linux__
+    watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    watch.fd = -1;
+#endif
+
+    return watch;
+}
+
+void watch_free(Watch* watch)
+{
+    da_foreach(Watch_File, file, watch->files)
+    {
+        string_free(&file->input);
+        string_free(&file->output);
+        parser_free(&file->parser);
+        free(file->content);
+        free(file->spare);
+    }
+
+    da_foreach(Watch_Dir, dir, watch->dirs)
+        string_free(&dir->path);
+
+    da_free(watch->files);
+    da_free(watch->dirs);
+    sink_close(&watch->rendered);
+
+#ifdef __linux__
+    if (watch->fd >= 0)
+        close(watch->fd);
+#endif
+}
+
+// Size and modification time mixed together, 0 if the file isn't there
+static uint64_t file_stamp(const char* path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+
+    uint64_t time = ((uint64_t) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    uint64_t size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    uint64_t time = (uint64_t) st.st_mtime * 1000000000;
+#ifdef __linux__
+    time += (uint64_t) st.st_mtim.tv_nsec;
+#endif
+    uint64_t size = (uint64_t) st.st_size;
+#endif
+
+    return (time * 1000003) ^ size ^ 1;
+}
+
+static int find_dir(Watch* watch, const char* path, int wd)
+{
+    for (int i = 0; i < (int) da_size(watch->dirs); i++)
+    {
+        Watch_Dir* dir = watch->dirs + i;
+        if (wd >= 0 ? dir->wd == wd : strcmp(dir->path, path) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+// Index of the dir, -1 if it can't be watched
+static int add_dir(Watch* watch, const char* path, int all)
+{
+    int wd = -1;
+#ifdef __linux__
+    if (watch->fd >= 0)
+    {
+        // The same directory under another name gives back the same wd
+        wd = inotify_add_watch(watch->fd, path, WATCH_EVENTS);
+        if (wd < 0)
+            return -1;
+    }
+#endif
+
+    int index = find_dir(watch, path, wd);
+    if (index >= 0)
+    {
+        watch->dirs[index].all |= all;
+        return index;
+    }
+
+    Watch_Dir dir = { string_make((char*) path), wd, all };
+    da_push_back(watch->dirs, dir);
+    return da_size(watch->dirs) - 1;
+}
+
+// Editors save by writing a new file and renaming it over the old one, so
+// files are watched through their directory and matched on their name
+static Watch_File* add_file(Watch* watch, const char* path, int all, int* is_new)
+{
+    const char* name = path;
+    for (const char* c = path; *c; c++)
+    {
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+
+    // "file" is in ".", "/file" in "/"
+    int parent_length = (int) (name - path) - 1;
+    String parent = (name == path)         ? string_make(".") :
+                    (parent_length == 0)   ? string_make_till_n((char*) path, 1) :
+                                             string_make_till_n((char*) path, parent_length);
+
+    int dir = add_dir(watch, parent, all);
+    string_free(&parent);
+
+    *is_new = 0;
+    if (dir < 0)
+        return NULL;
+
+    da_foreach(Watch_File, file, watch->files)
+    {
+        if (file->dir == dir && strcmp(file->name, name) == 0)
+            return file;
+    }
+
+    Watch_File file = { 0 };
+    file.input  = string_make((char*) path);
+    file.output = convert_extension((char*) path);
+    file.name   = file.input + (name - path);
+    file.dir    = dir;
+    file.parser = parser_make(NULL, 0, NULL);
+    file.stamp  = file_stamp(path);
+
+    da_push_back(watch->files, file);
+    *is_new = 1;
+    return watch->files + da_size(watch->files) - 1;
+}
+
+static void mark_changed(Watch_File* file, double now)
+{
+    if (file->changed_at == 0)
+        file->changed_at = now;
+
+    file->due = now + WATCH_DEBOUNCE_MS / 1000.0;
+}
+
+// For walk_directory, new files get converted
+static void found_file(void* user, const char* filepath, size_t size)
+{
+    (void) size;
+
+    Watch* watch = (Watch*) user;
+    if (!is_fountain((char*) filepath))
+        return;
+
+    int is_new;
+    Watch_File* file = add_file(watch, filepath, 1, &is_new);
+    if (file && is_new)
+        mark_changed(file, wall_clock());
+}
+
+#ifdef __linux__
+// Every directory under path needs its own watch, empty ones included.
+// Polling walks the top ones again instead.
+static void add_tree(Watch* watch, const char* path)
+{
+    if (add_dir(watch, path, 1) < 0)
+        return;
+
+    DIR* dir = opendir(path);
+    if (!dir)
+        return;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        String sub = string_make((char*) path);
+        string_append(&sub, "/");
+        string_append(&sub, entry->d_name);
+
+        // lstat so links to directories can't send us around in circles
+        struct stat st;
+        if (lstat(sub, &st) == 0 && S_ISDIR(st.st_mode))
+            add_tree(watch, sub);
+
+        string_free(&sub);
+    }
+
+    closedir(dir);
+}
+#endif
+
+static int add_directory(Watch* watch, const char* path)
+{
+#ifdef __linux__
+    if (watch->fd >= 0)
+        add_tree(watch, path);
+#endif
+
+    if (add_dir(watch, path, 1) < 0)
+        return 0;
+
+    return walk_directory(path, found_file, watch);
+}
+
+int watch_add_path(Watch* watch, const char* path)
+{
+    int is_directory;
+    size_t size;
+    if (!path_info(path, &is_directory, &size))
+    {
+        watch->missing++;
+        return 0;
+    }
+
+    if (is_directory)
+        return add_directory(watch, path);
+
+    if (!is_fountain((char*) path))
+        return 1;
+
+    int is_new;
+    return add_file(watch, path, 0, &is_new) != NULL;
+}
+
+#ifdef __linux__
+static void handle_event(Watch* watch, struct inotify_event* event, double now)
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        // Events were dropped, anything could have changed
+        da_foreach(Watch_File, file, watch->files)
+            mark_changed(file, now);
+
+        return;
+    }
+
+    int index = find_dir(watch, NULL, event->wd);
+    if (index < 0 || event->len == 0)
+        return;
+
+    String path = string_make(watch->dirs[index].path);
+    string_append(&path, "/");
+    string_append(&path, event->name);
+
+    int all = watch->dirs[index].all;
+    if (event->mask & IN_ISDIR)
+    {
+        // A new directory, it can come with files already in it
+        if (all && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+            add_directory(watch, path);
+    }
+    else if (is_fountain(path))
+    {
+        Watch_File* file = NULL;
+        da_foreach(Watch_File, f, watch->files)
+        {
+            if (f->dir == index && strcmp(f->name, event->name) == 0)
+            {
+                file = f;
+                break;
+            }
+        }
+
+        int is_new = 0;
+        if (!file && all)
+            file = add_file(watch, path, 1, &is_new);
+
+        if (file)
+            mark_changed(file, now);
+    }
+
+    string_free(&path);
+}
+
+static void read_events(Watch* watch, int timeout_ms)
+{
+    struct pollfd wait = { watch->fd, POLLIN, 0 };
+    if (poll(&wait, 1, timeout_ms) <= 0)
+        return;
+
+    union
+    {
+        struct inotify_event event;     // Just for the alignment
+        char bytes[16 * 1024];
+    } buffer;
+
+    double now = wall_clock();
+    while (1)
+    {
+        ssize_t got = read(watch->fd, buffer.bytes, sizeof(buffer.bytes));
+        if (got <= 0)
+            break;
+
+        for (char* at = buffer.bytes; at < buffer.bytes + got; )
+        {
+            struct inotify_event* event = (struct inotify_event*) at;
+            handle_event(watch, event, now);
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+#endif
+
+// Without inotify the files are looked at one by one, and the directories
+// walked again for new ones
+static void poll_files(Watch* watch, int timeout_ms)
+{
+    if (timeout_ms < 0 || timeout_ms > WATCH_POLL_MS)
+        timeout_ms = WATCH_POLL_MS;
+
+    thread_sleep_ms(timeout_ms);
+    double now = wall_clock();
+
+    da_foreach(Watch_File, file, watch->files)
+    {
+        uint64_t stamp = file_stamp(file->input);
+        if (stamp != file->stamp)
+        {
+            file->stamp = stamp;
+            mark_changed(file, now);
+        }
+    }
+
+    // found_file can add dirs
+    for (int i = 0; i < (int) da_size(watch->dirs); i++)
+    {
+        if (watch->dirs[i].all)
+            walk_directory(watch->dirs[i].path, found_file, watch);
+    }
+}
+
+static void wait_for_changes(Watch* watch, int timeout_ms)
+{
+#ifdef __linux__
+    if (watch->fd >= 0)
+    {
+        read_events(watch, timeout_ms);
+        return;
+    }
+#endif
+
+    poll_files(watch, timeout_ms);
+}
+
+// The new version goes into spare, the old one has to stay around for parser_edit.
+// spare is the version before that, nothing in the parser points into it
+// anymore so it can be freed, parser_edit moves the title page keys too.
+static int read_input(Watch_File* file, size_t* size)
+{
+    File_View input;
+    if (!load_file(file->input, &input))
+        return 0;
+
+    hd_assert(!file->spare || file->spare != file->parser.content);
+    if (!file->spare || file->spare_cap < input.size)
+    {
+        free(file->spare);
+        file->spare_cap = input.size + input.size / 4 + 1;
+        file->spare = (char*) malloc(file->spare_cap);
+        hd_assert(file->spare != NULL);
+    }
+
+    memcpy(file->spare, input.data, input.size);
+    *size = input.size;
+
+    unload_file(&input);
+    return 1;
+}
+
+// Tells the parser what changed between content and spare, then swaps them
+static void parse_input(Watch_File* file, size_t size)
+{
+    if (!file->parsed || file->edits >= WATCH_FULL_PARSE_EVERY)
+    {
+        parser_reset(&file->parser, file->spare, size);
+        parser_parse(&file->parser);
+        file->edits = 0;
+    }
+    else
+    {
+        // One edit from the first byte that differs to the last one
+        size_t shorter = (size < file->size) ? size : file->size;
+
+        size_t prefix = 0;
+        while (prefix < shorter && file->content[prefix] == file->spare[prefix])
+            prefix++;
+
+        size_t suffix = 0;
+        while (suffix < shorter - prefix && file->content[file->size - suffix - 1] == file->spare[size - suffix - 1])
+            suffix++;
+
+        parser_edit(&file->parser, file->spare, size, (int) prefix, (int) (file->size - suffix), (int) (size - suffix));
+        file->edits++;
+    }
+
+    char*  content = file->content;
+    size_t cap     = file->cap;
+    file->content   = file->spare;
+    file->cap       = file->spare_cap;
+    file->size      = size;
+    file->spare     = content;
+    file->spare_cap = cap;
+    file->parsed    = 1;
+}
+
+static void convert_file(Watch* watch, Watch_File* file)
+{
+    double start = wall_clock();
+    double changed_at = file->changed_at;
+    file->changed_at = 0;
+    file->due = 0;
+
+    size_t size;
+    if (!read_input(file, &size))
+    {
+        printf("Couldn't read file \"%s\"\n", file->input);
+        return;
+    }
+
+    // Saved without changes
+    if (file->parsed && size == file->size && memcmp(file->spare, file->content, size) == 0)
+        return;
+
+    parse_input(file, size);
+
+    Sink* rendered = &watch->rendered;
+    sb_clear(&rendered->buffer);
+    render_fdx(&file->parser, rendered);
+
+    const char* result = "unchanged";
+    uint64_t hash = hash_bytes(rendered->buffer.data, rendered->buffer.length, 0);
+    if (!file->written || hash != file->output_hash)
+    {
+        if (!write_file_atomic(file->output, rendered->buffer.data, rendered->buffer.length))
+        {
+            printf("Couldn't write file \"%s\"\n", file->output);
+            return;
+        }
+
+        file->output_hash = hash;
+        file->written = 1;
+        result = "written";
+    }
+
+    double end = wall_clock();
+    printf("%s %s in %.2f ms, %.2f ms after the change\n", file->output, result, (end - start) * 1000, (end - changed_at) * 1000);
+    fflush(stdout);
+}
+
+int watch_run(Watch* watch)
+{
+    if (da_size(watch->files) == 0 && da_size(watch->dirs) == 0)
+        return 0;
+
+    // Everything is converted once so the outputs start out fresh
+    double now = wall_clock();
+    da_foreach(Watch_File, file, watch->files)
+    {
+        file->changed_at = now;
+        file->due = now;
+    }
+
+    printf("Watching %d files%s\n", (int) da_size(watch->files), (watch->fd < 0) ? ", polling" : "");
+    fflush(stdout);
+
+    while (1)
+    {
+        now = wall_clock();
+        double next = 0;
+
+        for (int i = 0; i < (int) da_size(watch->files); i++)
+        {
+            Watch_File* file = watch->files + i;
+            if (file->due == 0)
+                continue;
+
+            if (file->due <= now)
+                convert_file(watch, file);
+            else if (next == 0 || file->due < next)
+                next = file->due;
+        }
+
+        int timeout_ms = (next > 0) ? (int) ((next - now) * 1000) + 1 : -1;
+        wait_for_changes(watch, timeout_ms);
+    }
+
+    return 1;
+}
\ No newline at end of file
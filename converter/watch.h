@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fountain.h"
+#include "sink.h"
+#include "containers/darray.h"
+#include "containers/string.h"
+
+// How long a file has to be left alone after it changes before it's converted,
+// editors tend to save in a couple of writes
+#ifndef WATCH_DEBOUNCE_MS
+#define WATCH_DEBOUNCE_MS 100
+#endif
+
+// Where inotify isn't there the files are checked this often instead
+#ifndef WATCH_POLL_MS
+#define WATCH_POLL_MS 250
+#endif
+
+// Edits only reparse around themselves but leave the old texts in the arena,
+// every so many a file is parsed from scratch so the arena starts over
+#ifndef WATCH_FULL_PARSE_EVERY
+#define WATCH_FULL_PARSE_EVERY 64
+#endif
+
+typedef struct _Watch_File
+{
+    String input;
+    String output;      // Next to the input with an .fdx extension
+    const char* name;   // The input's last path component, points into input
+    int dir;            // Index into Watch.dirs
+
+    Parser parser;      // Kept parsed between conversions, points into content
+    char*  content;     // The input as it was last converted
+    size_t size;
+    size_t cap;
+    char*  spare;       // The next version is read into this one, then they swap
+    size_t spare_cap;
+    int parsed;
+    int edits;          // Since the last full parse
+
+    uint64_t output_hash;   // Of what was last written
+    int written;
+
+    double changed_at;  // First change that hasn't been converted yet, 0 if there isn't one
+    double due;         // When to convert it, changed_at pushed back by every change after it
+    uint64_t stamp;     // Size and modification time, only used when polling
+} Watch_File;
+
+typedef struct _Watch_Dir
+{
+    String path;
+    int wd;             // inotify watch, -1 when polling
+    int all;            // New .fountain files in it are picked up, not just the ones given
+} Watch_Dir;
+
+typedef struct _Watch
+{
+    DArray(Watch_File) files;
+    DArray(Watch_Dir) dirs;
+    Sink rendered;      // Every conversion is rendered here, it keeps its capacity
+    int fd;             // inotify, -1 when polling
+    int missing;        // Paths given that couldn't be read
+} Watch;
+
+Watch watch_make(void);
+void  watch_free(Watch* watch);
+
+// Files are watched if they're .fountain files. Directories are watched with
+// everything under them, .fountain files that show up there later are picked
+// up too. Returns 0 if path couldn't be read.
+int watch_add_path(Watch* watch, const char* path);
+
+// Converts every file once, then again every time it changes. Only returns,
+// with 0, if there's nothing to watch.
+int watch_run(Watch* watch);
\ No newline at end of file
@@ -1,17 +1,188 @@
 #include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include "converter/filestuff.h"
 #include "converter/fountain.h"
 #include "converter/fdx.h"
 #include "converter/helpers.h"
+#include "converter/threads.h"
+#include "converter/batch.h"
+#include "converter/ir.h"
+#include "converter/watch.h"
+#include "converter/sink.h"
+#include "converter/stats.h"
 
 // #define DEBUG
 
 const char ff_help_string[] =
 "Convert .fountain file to .fdx.\n"
-"   usage: %s <in-path> <out-path>\n"
+"   usage: %s <in-path> <out-path> [-j <threads>] [--ir <file>] [--output mmap|writev [--sync none|async|wait]]\n"
+"             [--stats] [--stats-json]\n"
+"          %s --batch [-j <threads>] [--pipeline [--io-threads <n>]] [--manifest <file>]\n"
+"             [--cache <dir>] <paths...>\n"
+"          %s --watch <paths...>\n"
+"   either path can be - for stdin or stdout, the input is then converted as\n"
+"   it's read and memory stays the same however long it is\n"
+"   -j parses and writes big files on that many threads, 0 for one per core\n"
+"   --output mmap renders into the output file mapped at its exact size, --sync says\n"
+"   if it's flushed to disk before the converter exits (none by default). --output\n"
+"   writev hands the text to the file in place instead of copying it first.\n"
+"   --stats prints where the conversion's time and memory went to stderr once\n"
+"   it's done, --stats-json prints the same as JSON\n"
+"   --ir keeps the parsed screenplay in file, the next conversion of the same\n"
+"   input loads it from there instead of parsing\n"
+"   --batch converts every .fountain file in paths, directories included,\n"
+"   each .fdx goes next to its input. One thread per core unless -j is given.\n"
+"   --manifest reads more paths from file, one per line\n"
+"   --cache keeps every conversion in dir, unchanged inputs aren't parsed again\n"
+"   and outputs that would come out the same aren't rewritten\n"
+"   --pipeline reads and writes files on their own threads while the -j threads\n"
+"   parse, --io-threads sets how many of each (2 by default)\n"
+"   --watch converts the .fountain files in paths, then keeps converting them\n"
+"   as they're saved till it's stopped. Directories are watched for new ones.\n"
 ;
 
+static int run_batch(char** paths, int count, char* manifest, char* cache_dir, int threads, int io_threads)
+{
+    Batch batch = batch_make();
+
+    Fdx_Cache cache;
+    if (cache_dir)
+    {
+        if (!cache_open(&cache, cache_dir))
+        {
+            printf("Couldn't open cache \"%s\"\n", cache_dir);
+            batch_free(&batch);
+            return 1;
+        }
+
+        batch.cache = &cache;
+    }
+
+    if (manifest && !batch_add_manifest(&batch, manifest))
+        printf("Couldn't read file \"%s\"\n", manifest);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!batch_add_path(&batch, paths[i]))
+            printf("Couldn't read \"%s\"\n", paths[i]);
+    }
+
+    if (threads <= 0)
+        threads = thread_hardware_count();
+
+    Batch_Summary summary = (io_threads > 0) ? batch_run_pipelined(&batch, threads, io_threads)
+                                             : batch_run(&batch, threads);
+    batch_print_summary(&summary);
+
+    if (cache_dir)
+        cache_close(&cache);
+
+    batch_free(&batch);
+    return summary.failed > 0;
+}
+
+static int run_watch(char** paths, int count)
+{
+    Watch watch = watch_make();
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!watch_add_path(&watch, paths[i]))
+            printf("Couldn't watch \"%s\"\n", paths[i]);
+    }
+
+    int watched = watch_run(&watch);
+    if (!watched)
+        printf("Nothing to watch\n");
+
+    watch_free(&watch);
+    return !watched;
+}
+
+static size_t read_stream(void* user, char* buffer, size_t size)
+{
+    stats_start(timer);
+    size_t read = fread(buffer, sizeof(char), size, (FILE*) user);
+    stats_stop(timer, STATS_LOAD);
+
+    stats_add(bytes_in, read);
+    return read;
+}
+
+// One of the paths is "-". Errors go to stderr since stdout might be the output.
+static int run_stream(char* in_path, char* out_path)
+{
+    int from_stdin = string_cmp(in_path, "-");
+    int to_stdout  = string_cmp(out_path, "-");
+
+#ifdef _WIN32
+    // Text mode would turn every '\n' into "\r\n"
+    if (from_stdin) _setmode(_fileno(stdin), _O_BINARY);
+    if (to_stdout)  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    stats_start(timer);
+    File_View input = { 0 };
+    if (!from_stdin && !load_file(in_path, &input))
+    {
+        fprintf(stderr, "Couldn't read file \"%s\"\n", in_path);
+        return 1;
+    }
+    stats_stop(timer, STATS_LOAD);
+    stats_add(bytes_in, input.size);
+
+    Sink sink;
+    if (to_stdout)
+    {
+        sink = sink_make_fd(1);
+    }
+    else if (!sink_open_file(&sink, out_path))
+    {
+        fprintf(stderr, "Couldn't write file \"%s\"\n", out_path);
+        unload_file(&input);
+        return 1;
+    }
+
+    Parser parser = parser_make(input.data, input.size, NULL);
+    if (from_stdin)
+        stream_fdx_input(&parser, read_stream, stdin, &sink);
+    else
+        stream_fdx(&parser, &sink);
+
+    int read_ok = !from_stdin || !ferror(stdin);
+    int written = sink_close(&sink);
+    stats_add(bytes_out, sink.offset);
+
+    parser_free(&parser);
+    unload_file(&input);
+
+    if (!read_ok)
+        fprintf(stderr, "Couldn't read stdin\n");
+
+    if (!written)
+        fprintf(stderr, "Couldn't write %s\n", to_stdout ? "stdout" : out_path);
+
+    return !read_ok || !written;
+}
+
+// Only if they were asked for and kept
+static void report_stats(int text, int json)
+{
+    if (!stats.enabled)
+        return;
+
+    if (text)
+        stats_print(stderr, STATS_TEXT);
+    if (json)
+        stats_print(stderr, STATS_JSON);
+}
+
 #ifdef DEBUG
 int main()
 {
@@ -24,12 +195,129 @@ int main()
 int main(int argc, char* argv[])
 {
 #endif
+    // Pull the options out so the paths stay where they are
+    int threads = 1, threads_given = 0;
+    int batch = 0, io_threads = 0, watch = 0;
+    char* manifest = NULL;
+    char* cache_dir = NULL;
+    char* ir_path = NULL;
+    char* output_method = NULL;
+    Output_Sync sync = OUTPUT_SYNC_NONE;
+    int stats_text = 0, stats_json = 0;
+
+    int arg_count = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string_cmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            if (threads <= 0)
+                threads = thread_hardware_count();
+
+            threads_given = 1;
+        }
+        else if (string_cmp(argv[i], "--batch"))
+        {
+            batch = 1;
+        }
+        else if (string_cmp(argv[i], "--pipeline"))
+        {
+            if (io_threads == 0)
+                io_threads = 2;
+
+            batch = 1;
+        }
+        else if (string_cmp(argv[i], "--io-threads") && i + 1 < argc)
+        {
+            io_threads = atoi(argv[++i]);
+            if (io_threads <= 0)
+                io_threads = 2;
+
+            batch = 1;
+        }
+        else if (string_cmp(argv[i], "--watch"))
+        {
+            watch = 1;
+        }
+        else if (string_cmp(argv[i], "--output") && i + 1 < argc)
+        {
+            output_method = argv[++i];
+        }
+        else if (string_cmp(argv[i], "--sync") && i + 1 < argc)
+        {
+            i++;
+            if (string_cmp(argv[i], "async")) sync = OUTPUT_SYNC_ASYNC;
+            if (string_cmp(argv[i], "wait"))  sync = OUTPUT_SYNC_WAIT;
+        }
+        else if (string_cmp(argv[i], "--stats"))
+        {
+            stats_text = 1;
+        }
+        else if (string_cmp(argv[i], "--stats-json"))
+        {
+            stats_json = 1;
+        }
+        else if (string_cmp(argv[i], "--ir") && i + 1 < argc)
+        {
+            ir_path = argv[++i];
+        }
+        else if (string_cmp(argv[i], "--cache") && i + 1 < argc)
+        {
+            cache_dir = argv[++i];
+            batch = 1;
+        }
+        else if (string_cmp(argv[i], "--manifest") && i + 1 < argc)
+        {
+            manifest = argv[++i];
+            batch = 1;
+        }
+        else
+            argv[arg_count++] = argv[i];
+    }
+    argc = arg_count;
+
+    int mapped   = string_cmp(output_method, "mmap");
+    int gathered = string_cmp(output_method, "writev");
+    if (output_method && !mapped && !gathered)
+    {
+        printf("What output is this? \"%s\"\n", output_method);
+        return 1;
+    }
+
+    // Stats are timed on one thread, batches and watching don't fit that
+    if (stats_text || stats_json)
+    {
+        if (batch || watch)
+            fprintf(stderr, "Stats are only kept for a single conversion\n");
+        else if (!stats_enable())
+            fprintf(stderr, "This build doesn't keep stats\n");
+    }
+
+    if (watch)
+        return run_watch(argv + 1, argc - 1);
+
+    if (batch)
+        return run_batch(argv + 1, argc - 1, manifest, cache_dir, threads_given ? threads : 0, io_threads);
+
     if (argc < 2 || string_cmp(argv[1], "help"))
     {
-        printf(ff_help_string, argv[0]);
+        printf(ff_help_string, argv[0], argv[0], argv[0]);
         return 0;
     }
 
+    if (string_cmp(argv[1], "-") || (argc > 2 && string_cmp(argv[2], "-")))
+    {
+        if (argc < 3)
+        {
+            fprintf(stderr, "Where does it go? Give - as the output for stdout\n");
+            return 1;
+        }
+
+        int failed = run_stream(argv[1], argv[2]);
+        report_stats(stats_text, stats_json);
+        return failed;
+    }
+
     if (!is_fountain(argv[1]))
     {
         printf("What file is this? \"%s\"\n", argv[1]);
@@ -42,9 +330,69 @@ int main(int argc, char* argv[])
     else
         outfile = argv[2];
 
-    Parser parser = parser_make(load_file(argv[1]));
-    parser_parse(&parser);
-    generate_fdx(&parser, outfile);
+    stats_start(timer);
+    File_View input;
+    if (!load_file(argv[1], &input))
+    {
+        printf("Couldn't read file \"%s\"\n", argv[1]);
+        return 1;
+    }
+    stats_add(bytes_in, input.size);
+
+    // A saved parse is only good for exactly the same input
+    IR_View ir;
+    int from_ir = ir_path && ir_load(&ir, ir_path, NULL);
+    if (from_ir && ir.source_hash != ir_source_hash(input.data, input.size))
+    {
+        ir_unload(&ir);
+        from_ir = 0;
+    }
+    stats_stop(timer, STATS_LOAD);
+
+    Parser parser = parser_make(input.data, input.size, NULL);
+    int written;
+    if (!from_ir && !ir_path && threads <= 1 && !output_method)
+    {
+        // Nothing else needs the elements so they don't have to be kept
+        written = generate_fdx_streamed(&parser, outfile);
+    }
+    else
+    {
+        if (!from_ir)
+        {
+            if (threads > 1)
+                parser_parse_parallel(&parser, threads);
+            else
+                parser_parse(&parser);
+
+            if (ir_path && !ir_save(&parser, ir_path))
+                printf("Couldn't write file \"%s\"\n", ir_path);
+        }
+
+        Parser* parsed = from_ir ? &ir.parser : &parser;
+        if (mapped)
+            written = generate_fdx_mapped(parsed, outfile, sync);
+        else if (gathered)
+            written = generate_fdx_gathered(parsed, outfile);
+        else if (threads > 1)
+            written = generate_fdx_parallel(parsed, outfile, threads);
+        else
+            written = generate_fdx(parsed, outfile);
+    }
+
+    if (from_ir)
+        ir_unload(&ir);
+
+    parser_free(&parser);
+    unload_file(&input);
+
+    report_stats(stats_text, stats_json);
+
+    if (!written)
+    {
+        printf("Couldn't write file \"%s\"\n", outfile);
+        return 1;
+    }
 
     printf("%s\n", outfile);
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+// Replays random edits on screenplays through parser_edit. Built with
+// PARSER_VERIFY_EDITS (see build.sh), so every edit is checked against a full
+// parse of the result and the first one that comes out different stops it
+// with an assert. The edits are the kind typing makes: characters and
+// blank lines going in and out, emphasis markers, whole scenes and dialogue
+// blocks pasted or cut, boneyard and page breaks. The same seed always gives
+// the same edits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "converter/filestuff.h"
+#include "converter/fountain.h"
+
+#ifndef PARSER_VERIFY_EDITS
+#error "Build with PARSER_VERIFY_EDITS, ./build.sh verify does"
+#endif
+
+const char verify_help_string[] =
+"Check parser_edit against full parses on random edits.\n"
+"   usage: %s [options] [files...]\n"
+"\n"
+"   --seed N    Seed for the edits (default 1)\n"
+"   --edits N   Edits per file (default 2000)\n"
+"\n"
+"   Without files the .fountain files in tests/ are used.\n"
+;
+
+static const char* snippets[] = {
+    "\n\nINT. HOUSE - DAY\n\n", "\n\nEXT. ROAD - NIGHT\n\nBOB\nHello *there*.\n\n", "\n===\n",
+    "/* bone\n\nyard */", "[[a note]]", "\n\n> CUT TO:\n\n", "\n\nFADE OUT TO:\n\n", ">centered<",
+    "\n\nALICE (V.O.)\nWhat?\n\n", "JOHN\n", "(quietly)\n", "@mcClane\n", "\n\n.FORCED\n\n",
+    "Title: The Edit\nAuthor: Someone\n\n", "Some action text.", "*", "**", "_", "\\*",
+    "\n", "\n\n", "\r\n", "  ", "\t", "x", "",
+};
+
+#define count_of(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+// xorshift64*, like the screenplay generator
+static uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_int(uint64_t* state, int n)
+{
+    return (int) ((next_random(state) >> 33) % (uint64_t) n);
+}
+
+// Returns the number of edits made, the first wrong one doesn't return
+static int replay_edits(const char* filepath, int edits, uint64_t seed)
+{
+    File_View file;
+    if (!load_file(filepath, &file))
+    {
+        fprintf(stderr, "Couldn't read file \"%s\"\n", filepath);
+        return -1;
+    }
+
+    // The parser keeps pointing into the content, so it gets its own copy that edits can replace
+    int length = (int) file.size;
+    char* content = (char*) malloc(file.size + 1);
+    memcpy(content, file.data, file.size);
+    unload_file(&file);
+
+    Parser parser = parser_make(content, length, NULL);
+    parser_parse(&parser);
+
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (int i = 0; i < edits; i++)
+    {
+        // Mostly small, every so often a big cut
+        int start   = length ? random_int(&state, length + 1) : 0;
+        int removed = random_int(&state, 8) == 0 ? random_int(&state, 400) : random_int(&state, 4);
+        if (removed > length - start)
+            removed = length - start;
+
+        const char* text = snippets[random_int(&state, count_of(snippets))];
+        int added = (int) strlen(text);
+
+        int next_length = length - removed + added;
+        char* next = (char*) malloc((size_t) next_length + 1);
+        memcpy(next, content, start);
+        memcpy(next + start, text, added);
+        memcpy(next + start + added, content + start + removed, length - start - removed);
+
+        parser_edit(&parser, next, next_length, start, start + removed, start + added);
+
+        free(content);
+        content = next;
+        length  = next_length;
+    }
+
+    parser_free(&parser);
+    free(content);
+    return edits;
+}
+
+typedef struct _File_List
+{
+    char** paths;
+    int count;
+} File_List;
+
+static void add_fountain_file(void* user, const char* filepath, size_t size)
+{
+    File_List* list = (File_List*) user;
+    size_t length = strlen(filepath);
+    (void) size;
+
+    if (length < 9 || strcmp(filepath + length - 9, ".fountain") != 0)
+        return;
+
+    list->paths = (char**) realloc(list->paths, sizeof(char*) * (list->count + 1));
+    list->paths[list->count] = (char*) malloc(length + 1);
+    memcpy(list->paths[list->count], filepath, length + 1);
+    list->count++;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t seed = 1;
+    int edits = 2000;
+    File_List files = { 0 };
+
+    // hd_assert stops the program right after printing, nothing buffered would be seen
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        int has_value = i + 1 < argc;
+
+        if      (strcmp(arg, "--seed") == 0 && has_value)  seed  = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(arg, "--edits") == 0 && has_value) edits = atoi(argv[++i]);
+        else if (arg[0] == '-')
+        {
+            printf(verify_help_string, argv[0]);
+            return strcmp(arg, "--help") != 0;
+        }
+        else
+            add_fountain_file(&files, arg, 0);
+    }
+
+    if (files.count == 0 && !walk_directory("tests", add_fountain_file, &files))
+    {
+        fprintf(stderr, "No files given and there's no tests/ to use\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < files.count; i++)
+    {
+        int made = replay_edits(files.paths[i], edits, seed);
+        if (made < 0)
+            failed = 1;
+        else
+            printf("%-40s %d edits checked\n", files.paths[i], made);
+
+        free(files.paths[i]);
+    }
+
+    free(files.paths);
+    return failed;
+}
\ No newline at end of file